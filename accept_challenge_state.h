@@ -1,25 +1,61 @@
 #pragma once
 
-#include <fstream>
 #include <iostream>
+#include <memory>
 #include <variant>
 
+#include "challenge_admission.h"
+#include "coro_state.h"
+#include "in_battle_state.h"
 #include "showdown_state_machine.h"
 
 namespace ps_client {
-class AcceptChallengeState : public ShowdownClientStateMachine::StateAction {
- public:
-  ShowdownClientStateEnum NextState(
-      ShowdownClientStateMachine::ContextType* context) override {
-    if (std::holds_alternative<WebsocketMessage>(context->last_message)) {
-      WebsocketMessage message =
-          std::get<WebsocketMessage>(context->last_message);
-      if (message.header == "b") {
-        std::cout << "Entering battle" << std::endl;
-        return ShowdownClientStateEnum::kInBattle;
+// Waits for the battle of an accepted challenge to start, queueing the
+// challenges that keep coming in. The battle starts with the "|init|battle"
+// frame from its room, which already has the battle's opening lines. Goes
+// back to the lobby if every accepted challenge timed out before its battle
+// started.
+inline ShowdownClientCoroMachine::Task AcceptChallenge(
+    ShowdownClientCoroMachine& machine, WebsocketState* context,
+    std::shared_ptr<ChallengeAdmission> admission) {
+  // Only new challenges, battle starts and challenge wake-ups matter here.
+  const ShowdownClientCoroMachine::Matcher wanted =
+      MatchHeader({"pm", "init", "deadline"});
+  for (;;) {
+    // Without a wanted message, wake up when the battle should have started.
+    bool arrived = co_await machine.Next(wanted, admission->StartTimeout());
+    if (arrived) {
+      if (const auto* compound_message =
+              std::get_if<CompoundWebsocketMessage>(&context->last_message);
+          compound_message != nullptr &&
+          admission->OnBattleFrame(*compound_message)) {
+        std::cout << "Entering battle " << compound_message->room << std::endl;
+        if (ForwardBattleMessages(context, *compound_message)) {
+          admission->OnBattleEnded(compound_message->room);
+        }
+        co_return ShowdownClientStateEnum::kInBattle;
       }
+      if (const auto* message =
+              std::get_if<WebsocketMessage>(&context->last_message);
+          message != nullptr && message->header == "pm") {
+        HandleChallenge(context, *admission, *message);
+      }
+    }
+    AdmitChallenges(context, *admission);
+    if (admission->ActiveBattles() == 0) {
+      co_return ShowdownClientStateEnum::kJoinLobby;
     }
-    return ShowdownClientStateEnum::kAcceptChallenge;
   }
-};
+}
+
+// The accept state for ShowdownClientStateMachine.
+inline std::unique_ptr<CoroState> MakeAcceptChallengeState(
+    std::shared_ptr<ChallengeAdmission> admission) {
+  return std::make_unique<CoroState>(
+      ShowdownClientStateEnum::kAcceptChallenge,
+      [admission = std::move(admission)](ShowdownClientCoroMachine& machine,
+                                         WebsocketState* context) {
+        return AcceptChallenge(machine, context, admission);
+      });
+}
 }  // namespace ps_client
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <variant>
+
+#include "dex.h"
+#include "showdown_state_machine.h"
+
+namespace ps_client {
+
+// Names in battle lines resolved to dex ids. Positions such as "p1a" and
+// nicknames are left as views into the message.
+
+// "|move|p1a: Nick|Earthquake|p2a: Nick2"
+struct MoveEvent {
+  std::string_view position;
+  dex::MoveId move;
+  std::string_view target;
+};
+
+// "|switch|p1a: Nick|Garchomp, L50, M|100/100", also drag and replace.
+struct SwitchEvent {
+  std::string_view position;
+  dex::SpeciesId species;
+  std::string_view hp;
+};
+
+// "|poke|p1|Garchomp, L50, M|" during team preview.
+struct PreviewEvent {
+  std::string_view side;
+  dex::SpeciesId species;
+};
+
+// "|-item|p1a: Nick|Leftovers" or "|-enditem|p1a: Nick|Air Balloon".
+struct ItemEvent {
+  std::string_view position;
+  dex::ItemId item;
+  bool ended;
+};
+
+// "|-ability|p1a: Nick|Intimidate"
+struct AbilityEvent {
+  std::string_view position;
+  dex::AbilityId ability;
+};
+
+using BattleEvent = std::variant<MoveEvent, SwitchEvent, PreviewEvent,
+                                 ItemEvent, AbilityEvent>;
+
+namespace battle_events_internal {
+
+// Splits up to N '|'-separated fields without allocating. Missing fields
+// are empty.
+template <size_t N>
+std::array<std::string_view, N> SplitFields(std::string_view contents) {
+  std::array<std::string_view, N> fields;
+  for (size_t i = 0; i < N; ++i) {
+    size_t delim = contents.find('|');
+    fields[i] = contents.substr(0, delim);
+    if (delim == std::string_view::npos) {
+      break;
+    }
+    contents.remove_prefix(delim + 1);
+  }
+  return fields;
+}
+
+// The species of "Garchomp, L50, M" is the part before the first comma.
+inline dex::SpeciesId SpeciesFromDetails(std::string_view details) {
+  return dex::ToSpeciesId(details.substr(0, details.find(',')));
+}
+
+}  // namespace battle_events_internal
+
+// Parses a battle line into an event, or nullopt for lines without names
+// to resolve. Unknown names are reported as kUnknown ids.
+inline std::optional<BattleEvent> ParseBattleEvent(
+    const WebsocketMessage& message) {
+  using battle_events_internal::SpeciesFromDetails;
+  using battle_events_internal::SplitFields;
+
+  std::string_view header = message.header;
+  if (header == "move") {
+    auto fields = SplitFields<3>(message.contents);
+    return MoveEvent{fields[0], dex::ToMoveId(fields[1]), fields[2]};
+  }
+  if (header == "switch" || header == "drag" || header == "replace") {
+    auto fields = SplitFields<3>(message.contents);
+    return SwitchEvent{fields[0], SpeciesFromDetails(fields[1]), fields[2]};
+  }
+  if (header == "poke") {
+    auto fields = SplitFields<2>(message.contents);
+    return PreviewEvent{fields[0], SpeciesFromDetails(fields[1])};
+  }
+  if (header == "-item" || header == "-enditem") {
+    auto fields = SplitFields<2>(message.contents);
+    return ItemEvent{fields[0], dex::ToItemId(fields[1]),
+                     header == "-enditem"};
+  }
+  if (header == "-ability") {
+    auto fields = SplitFields<2>(message.contents);
+    return AbilityEvent{fields[0], dex::ToAbilityId(fields[1])};
+  }
+  return std::nullopt;
+}
+
+}  // namespace ps_client
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "battle_events.h"
+#include "dex.h"
+#include "showdown_state_machine.h"
+
+namespace ps_client {
+
+// What each side of a battle has revealed so far, kept as dex ids: the
+// Pokémon seen in team preview or sent out, and their moves, items and
+// abilities. Only used from the message handling thread.
+class BattleTracker {
+ public:
+  struct Pokemon {
+    // Nickname from positions such as "p1a: Nick", empty if only seen in
+    // team preview.
+    std::string name;
+    dex::SpeciesId species{};
+    dex::ItemId item{};
+    dex::AbilityId ability{};
+    std::array<dex::MoveId, 4> moves{};
+    uint8_t num_moves = 0;
+  };
+
+  struct Battle {
+    std::array<std::vector<Pokemon>, 2> sides;
+  };
+
+  // Records the names revealed by a battle line of `room`.
+  void OnLine(std::string_view room, const WebsocketMessage& message) {
+    std::optional<BattleEvent> event = ParseBattleEvent(message);
+    if (!event.has_value()) {
+      return;
+    }
+    Battle& battle = FindOrAdd(room);
+    std::visit([&battle](const auto& e) { Apply(battle, e); },
+               event.value());
+  }
+
+  // The battle in `room`, or nullptr if nothing was revealed in it.
+  const Battle* Find(std::string_view room) const {
+    for (const auto& [battle_room, battle] : battles_) {
+      if (battle_room == room) {
+        return &battle;
+      }
+    }
+    return nullptr;
+  }
+
+  // Prints what was revealed in `room` and forgets the battle.
+  void OnBattleEnded(std::string_view room) {
+    auto it = std::find_if(
+        battles_.begin(), battles_.end(),
+        [room](const auto& entry) { return entry.first == room; });
+    if (it == battles_.end()) {
+      return;
+    }
+    for (size_t side = 0; side < it->second.sides.size(); ++side) {
+      std::cout << "[battle] " << room << " p" << side + 1 << ":";
+      for (const Pokemon& pokemon : it->second.sides[side]) {
+        std::cout << " " << dex::Name(pokemon.species) << "(";
+        for (uint8_t i = 0; i < pokemon.num_moves; ++i) {
+          std::cout << (i > 0 ? "/" : "") << dex::Name(pokemon.moves[i]);
+        }
+        std::cout << ")";
+      }
+      std::cout << std::endl;
+    }
+    battles_.erase(it);
+  }
+
+ private:
+  Battle& FindOrAdd(std::string_view room) {
+    for (auto& [battle_room, battle] : battles_) {
+      if (battle_room == room) {
+        return battle;
+      }
+    }
+    return battles_.emplace_back(std::string(room), Battle{}).second;
+  }
+
+  // The side of "p1a: Nick" or "p1", or nullptr for other sides.
+  static std::vector<Pokemon>* SideOf(Battle& battle,
+                                      std::string_view position) {
+    if (position.size() < 2 || position[0] != 'p' ||
+        (position[1] != '1' && position[1] != '2')) {
+      return nullptr;
+    }
+    return &battle.sides[position[1] - '1'];
+  }
+
+  // "Nick" from "p1a: Nick".
+  static std::string_view NameOf(std::string_view position) {
+    size_t colon = position.find(": ");
+    return colon == std::string_view::npos ? std::string_view()
+                                           : position.substr(colon + 2);
+  }
+
+  static Pokemon* FindPokemon(Battle& battle, std::string_view position) {
+    std::vector<Pokemon>* side = SideOf(battle, position);
+    if (side == nullptr) {
+      return nullptr;
+    }
+    std::string_view name = NameOf(position);
+    for (Pokemon& pokemon : *side) {
+      if (pokemon.name == name) {
+        return &pokemon;
+      }
+    }
+    return nullptr;
+  }
+
+  static void Apply(Battle& battle, const SwitchEvent& event) {
+    std::vector<Pokemon>* side = SideOf(battle, event.position);
+    if (side == nullptr) {
+      return;
+    }
+    if (Pokemon* pokemon = FindPokemon(battle, event.position)) {
+      // Forme changes come as a new species on a drag or replace.
+      pokemon->species = event.species;
+      return;
+    }
+    // The first switch in of a Pokémon seen in team preview names it.
+    for (Pokemon& pokemon : *side) {
+      if (pokemon.name.empty() && pokemon.species == event.species) {
+        pokemon.name = NameOf(event.position);
+        return;
+      }
+    }
+    side->push_back(
+        Pokemon{std::string(NameOf(event.position)), event.species});
+  }
+
+  static void Apply(Battle& battle, const PreviewEvent& event) {
+    if (std::vector<Pokemon>* side = SideOf(battle, event.side)) {
+      side->push_back(Pokemon{"", event.species});
+    }
+  }
+
+  static void Apply(Battle& battle, const MoveEvent& event) {
+    Pokemon* pokemon = FindPokemon(battle, event.position);
+    if (pokemon == nullptr || event.move == dex::MoveId::kUnknown) {
+      return;
+    }
+    auto moves_end = pokemon->moves.begin() + pokemon->num_moves;
+    if (std::find(pokemon->moves.begin(), moves_end, event.move) ==
+            moves_end &&
+        pokemon->num_moves < pokemon->moves.size()) {
+      pokemon->moves[pokemon->num_moves++] = event.move;
+    }
+  }
+
+  static void Apply(Battle& battle, const ItemEvent& event) {
+    if (Pokemon* pokemon = FindPokemon(battle, event.position)) {
+      pokemon->item = event.ended ? dex::ItemId::kUnknown : event.item;
+    }
+  }
+
+  static void Apply(Battle& battle, const AbilityEvent& event) {
+    if (Pokemon* pokemon = FindPokemon(battle, event.position)) {
+      pokemon->ability = event.ability;
+    }
+  }
+
+  std::vector<std::pair<std::string, Battle>> battles_;
+};
+
+}  // namespace ps_client
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "deadline_timers.h"
+#include "showdown_state_machine.h"
+#include "util.h"
+
+namespace ps_client {
+
+using Clock = std::chrono::steady_clock;
+
+// A challenge received in a private message.
+struct Challenge {
+  std::string user;
+  // Empty when the challenge was withdrawn.
+  std::string format;
+  Clock::time_point received_at;
+
+  // Parses "|pm| SENDER| RECEIVER|/challenge FORMAT|...".
+  static std::optional<Challenge> CreateChallenge(
+      const WebsocketMessage& message, Clock::time_point now) {
+    if (message.header != "pm") {
+      return std::nullopt;
+    }
+    std::vector<std::string_view> split_message =
+        util::SplitLine(message.contents);
+    if (split_message.size() <= 2 || split_message[0].empty() ||
+        !split_message[2].starts_with("/challenge")) {
+      return std::nullopt;
+    }
+    std::string_view format = split_message[2].substr(10);
+    format.remove_prefix(std::min(format.find_first_not_of(' '), format.size()));
+    // The first character of the sender is its rank.
+    return Challenge{std::string(split_message[0].substr(1)),
+                     std::string(format), now};
+  }
+};
+
+struct AdmissionConfig {
+  // Battles accepted at the same time.
+  size_t max_concurrent_battles = 1;
+  // Challenges waiting for a free battle slot; more are rejected.
+  size_t max_pending = 8;
+  // Pending challenges older than this are rejected.
+  Clock::duration challenge_timeout = std::chrono::seconds(60);
+  // Accepted challenges that never start a battle free their slot after this.
+  Clock::duration start_timeout = std::chrono::seconds(30);
+};
+
+// Queues incoming challenges and accepts them while fewer than
+// `max_concurrent_battles` battles are in progress. Only used from the
+// message handling thread.
+class ChallengeAdmission {
+ public:
+  explicit ChallengeAdmission(const AdmissionConfig& config = {})
+      : config_(config) {}
+
+  // Handles a challenge or its withdrawal. A new challenge from a user
+  // replaces the one queued before. Returns false if the challenge does not
+  // fit in the queue and should be rejected.
+  bool Offer(Challenge challenge) {
+    std::erase_if(pending_, [&challenge](const Challenge& c) {
+      return c.user == challenge.user;
+    });
+    if (challenge.format.empty()) {
+      return true;
+    }
+    if (pending_.size() >= config_.max_pending) {
+      ++rejected_;
+      return false;
+    }
+    pending_.push_back(std::move(challenge));
+    return true;
+  }
+
+  // Removes pending challenges past the timeout and frees slots of accepted
+  // challenges that never started. Returns the users to reject.
+  std::vector<std::string> Expire(Clock::time_point now) {
+    std::vector<std::string> expired;
+    while (!pending_.empty() &&
+           now - pending_.front().received_at >= config_.challenge_timeout) {
+      expired.push_back(std::move(pending_.front().user));
+      pending_.pop_front();
+    }
+    std::erase_if(battles_, [this, now](const Battle& battle) {
+      return battle.room.empty() &&
+             now - battle.accepted_at > config_.start_timeout;
+    });
+    expired_ += expired.size();
+    return expired;
+  }
+
+  // Takes the oldest pending challenge if a battle slot is free.
+  std::optional<Challenge> Admit(Clock::time_point now) {
+    if (pending_.empty() || battles_.size() >= config_.max_concurrent_battles) {
+      return std::nullopt;
+    }
+    Challenge challenge = std::move(pending_.front());
+    pending_.pop_front();
+    battles_.push_back(Battle{"", now});
+
+    Clock::duration latency = now - challenge.received_at;
+    ++accepted_;
+    total_accept_latency_ += latency;
+    max_accept_latency_ = std::max(max_accept_latency_, latency);
+    return challenge;
+  }
+
+  // Binds the room of a battle's first frame to the oldest accepted
+  // challenge without one. Returns true if the frame belongs to a battle in
+  // progress. Rooms of ended battles are never bound again, so their late
+  // frames cannot take the slot of the next challenge.
+  bool OnBattleFrame(const CompoundWebsocketMessage& frame) {
+    std::string_view room = frame.room;
+    if (!room.starts_with("battle-") || ended_rooms_.contains(room)) {
+      return false;
+    }
+    for (const Battle& battle : battles_) {
+      if (battle.room == room) {
+        return true;
+      }
+    }
+    if (!frame.StartsBattle()) {
+      return false;
+    }
+    for (Battle& battle : battles_) {
+      if (battle.room.empty()) {
+        battle.room = room;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Frees the slot of a finished battle.
+  void OnBattleEnded(std::string_view room) {
+    ended_rooms_.emplace(room);
+    auto it = std::find_if(
+        battles_.begin(), battles_.end(),
+        [room](const Battle& battle) { return battle.room == room; });
+    if (it != battles_.end()) {
+      battles_.erase(it);
+      ++finished_;
+    }
+  }
+
+  // Takes a slot for a battle restored from a snapshot.
+  void RestoreBattle(std::string_view room) {
+    battles_.push_back(Battle{std::string(room), Clock::now()});
+  }
+
+  // The oldest pending challenge and the time until it is stale, if any.
+  std::optional<std::pair<std::string_view, Clock::duration>> NextStale(
+      Clock::time_point now) const {
+    if (pending_.empty()) {
+      return std::nullopt;
+    }
+    const Challenge& front = pending_.front();
+    return std::make_pair(std::string_view(front.user),
+                          front.received_at + config_.challenge_timeout - now);
+  }
+
+  size_t ActiveBattles() const { return battles_.size(); }
+  Clock::duration ChallengeTimeout() const { return config_.challenge_timeout; }
+  Clock::duration StartTimeout() const { return config_.start_timeout; }
+  size_t PendingChallenges() const { return pending_.size(); }
+
+  void PrintStats(std::ostream& os) const {
+    using std::chrono::duration_cast;
+    using std::chrono::milliseconds;
+    os << "active=" << battles_.size() << "/" << config_.max_concurrent_battles
+       << " pending=" << pending_.size() << " accepted=" << accepted_
+       << " finished=" << finished_ << " rejected=" << rejected_
+       << " expired=" << expired_;
+    if (accepted_ > 0) {
+      os << " accept_latency_avg_ms="
+         << duration_cast<milliseconds>(total_accept_latency_).count() /
+                accepted_
+         << " accept_latency_max_ms="
+         << duration_cast<milliseconds>(max_accept_latency_).count();
+    }
+    os << std::endl;
+  }
+
+ private:
+  struct Battle {
+    // Empty until the first frame of the battle arrives.
+    std::string room;
+    Clock::time_point accepted_at;
+  };
+
+  AdmissionConfig config_;
+  std::deque<Challenge> pending_;
+  std::vector<Battle> battles_;
+  // Rooms of battles that ended in this session.
+  std::set<std::string, std::less<>> ended_rooms_;
+  uint64_t accepted_ = 0;
+  uint64_t finished_ = 0;
+  uint64_t rejected_ = 0;
+  uint64_t expired_ = 0;
+  Clock::duration total_accept_latency_{0};
+  Clock::duration max_accept_latency_{0};
+};
+
+// Queues a challenge from `message`, rejecting it if the queue is full.
+inline void HandleChallenge(WebsocketState* context,
+                            ChallengeAdmission& admission,
+                            const WebsocketMessage& message) {
+  std::optional<Challenge> challenge =
+      Challenge::CreateChallenge(message, Clock::now());
+  if (!challenge.has_value()) {
+    return;
+  }
+  std::cout << "[admission] challenger: " << challenge->user << " "
+            << challenge->format << std::endl;
+  std::string user = challenge->user;
+  if (!admission.Offer(std::move(challenge.value()))) {
+    context->socket_write("/reject " + user);
+  } else if (context->timers) {
+    // Wakes the state machine up to expire the challenge if nothing else
+    // arrives in the meantime.
+    context->timers->ArmFor(user, "challenge", admission.ChallengeTimeout());
+  }
+}
+
+// True if the last message is the current wake-up armed by
+// HandleChallenge.
+inline bool TakeChallengeDeadline(WebsocketState* context) {
+  const auto* message = std::get_if<WebsocketMessage>(&context->last_message);
+  if (message == nullptr || message->header != "deadline") {
+    return false;
+  }
+  std::optional<DeadlineTimers::Expired> expired =
+      DeadlineTimers::Parse(message->contents);
+  return expired.has_value() && expired->kind == "challenge" &&
+         context->timers->Take(*expired);
+}
+
+// Rejects stale challenges and accepts queued ones while battle slots are
+// free. Returns the number of challenges accepted.
+inline size_t AdmitChallenges(WebsocketState* context,
+                              ChallengeAdmission& admission) {
+  Clock::time_point now = Clock::now();
+  for (const std::string& user : admission.Expire(now)) {
+    context->socket_write("/reject " + user);
+  }
+  // If the wake-up came before the oldest challenge went stale, wake up
+  // again when it does, so it does not wait for unrelated traffic.
+  if (context->timers && TakeChallengeDeadline(context)) {
+    if (auto next = admission.NextStale(now)) {
+      context->timers->ArmFor(next->first, "challenge", next->second);
+    }
+  }
+  size_t accepted = 0;
+  while (std::optional<Challenge> challenge = admission.Admit(now)) {
+    context->socket_write("/accept " + challenge->user);
+    ++accepted;
+  }
+  if (accepted > 0) {
+    std::cout << "[admission] ";
+    admission.PrintStats(std::cout);
+  }
+  return accepted;
+}
+
+}  // namespace ps_client
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <variant>
+
+#include "deadline_timers.h"
+#include "showdown_state_machine.h"
+
+namespace ps_client {
+
+// Runs a state written as a coroutine in ShowdownClientStateMachine. The
+// coroutine gets every message while the state is current, and the state it
+// co_returns is handed back to the outer machine. A wait with a timeout is
+// armed on the context's timers and comes back as
+// "|deadline|coro|timeout|ID", which resumes the coroutine with the wait
+// timed out unless the wait ended in the meantime.
+class CoroState : public ShowdownClientStateMachine::StateAction {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  CoroState(ShowdownClientStateEnum state,
+            ShowdownClientCoroMachine::StateFn state_fn)
+      : state_(state), state_fn_(std::move(state_fn)) {}
+
+  void EnterState(ShowdownClientStateMachine::ContextType* context) override {
+    if (!machine_) {
+      machine_ = std::make_unique<ShowdownClientCoroMachine>(context);
+      machine_->AddState(state_, state_fn_);
+    }
+    machine_->Start(state_);
+    ArmTimeout(context);
+  }
+
+  ShowdownClientStateEnum NextState(
+      ShowdownClientStateMachine::ContextType* context) override {
+    if (IsTimeout(context)) {
+      armed_.reset();
+      machine_->Tick(Clock::now());
+    } else {
+      machine_->Update();
+    }
+    ArmTimeout(context);
+    return machine_->CurrentState();
+  }
+
+  void ExitState(ShowdownClientStateMachine::ContextType* context) override {
+    if (context->timers) {
+      context->timers->CancelFor(kRoom, kKind);
+    }
+    armed_.reset();
+  }
+
+ private:
+  static constexpr std::string_view kRoom = "coro";
+  static constexpr std::string_view kKind = "timeout";
+
+  static bool IsTimeout(WebsocketState* context) {
+    const auto* message = std::get_if<WebsocketMessage>(&context->last_message);
+    if (message == nullptr || message->header != "deadline" ||
+        !context->timers) {
+      return false;
+    }
+    std::optional<DeadlineTimers::Expired> expired =
+        DeadlineTimers::Parse(message->contents);
+    return expired.has_value() && expired->room == kRoom &&
+           expired->kind == kKind && context->timers->Take(*expired);
+  }
+
+  // Keeps the timer in step with the wait the coroutine is in.
+  void ArmTimeout(WebsocketState* context) {
+    if (!context->timers) {
+      return;
+    }
+    std::optional<Clock::time_point> deadline =
+        machine_->Running() ? machine_->Deadline() : std::nullopt;
+    if (deadline == armed_) {
+      return;
+    }
+    if (deadline.has_value()) {
+      context->timers->ArmFor(
+          kRoom, kKind, std::max(Clock::duration(0), *deadline - Clock::now()));
+    } else {
+      context->timers->CancelFor(kRoom, kKind);
+    }
+    armed_ = deadline;
+  }
+
+  ShowdownClientStateEnum state_;
+  ShowdownClientCoroMachine::StateFn state_fn_;
+  // Created on the first entry, on the thread that drives the machine.
+  std::unique_ptr<ShowdownClientCoroMachine> machine_;
+  std::optional<Clock::time_point> armed_;
+};
+
+}  // namespace ps_client
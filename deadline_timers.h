@@ -0,0 +1,189 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "timer_wheel.h"
+#include "util.h"
+
+namespace ps_client {
+
+// Deadlines for states of the client, e.g. answering a battle request before
+// the battle timer runs out. Timers are kept in a timing wheel that a single
+// steady_timer on the io_context advances every `resolution`. An expired
+// deadline is delivered as an ordinary "|deadline|ROOM|KIND|ID" message, no
+// earlier than its delay and at most about one resolution later. A deadline
+// can be cancelled while its message is queued, so handlers check it with
+// Take before acting on it.
+// Arming and cancelling is safe from any thread.
+class DeadlineTimers {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using TimerId = util::TimerWheel<int>::TimerId;
+  // Receives the message of an expired deadline, on the io_context thread.
+  using DeliverFn = std::function<void(const std::string& message)>;
+
+  // A deadline read back from its message.
+  struct Expired {
+    std::string_view room;
+    std::string_view kind;
+    TimerId id;
+  };
+
+  // Parses the contents of a "|deadline|ROOM|KIND|ID" message.
+  static std::optional<Expired> Parse(std::string_view contents) {
+    size_t id_start = contents.rfind('|');
+    if (id_start == std::string_view::npos || id_start == 0) {
+      return std::nullopt;
+    }
+    size_t kind_start = contents.rfind('|', id_start - 1);
+    Expired expired;
+    if (kind_start == std::string_view::npos ||
+        !util::ParseNumber(contents.substr(id_start + 1), expired.id)) {
+      return std::nullopt;
+    }
+    expired.room = contents.substr(0, kind_start);
+    expired.kind = contents.substr(kind_start + 1, id_start - kind_start - 1);
+    return expired;
+  }
+
+  DeadlineTimers(boost::asio::io_context& ioc, DeliverFn deliver,
+                 Clock::duration resolution = std::chrono::milliseconds(100))
+      : timer_(ioc),
+        deliver_(std::move(deliver)),
+        resolution_(resolution),
+        epoch_(Clock::now()) {}
+
+  // Starts advancing the wheel.
+  void Start() { ScheduleTick(); }
+
+  // Arms a deadline for `kind` in `room`.
+  TimerId Arm(std::string_view room, std::string_view kind,
+              Clock::duration delay) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return wheel_.Arm(ToTicks(delay), Deadline{std::string(room),
+                                               std::string(kind)});
+  }
+
+  bool Cancel(TimerId id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return wheel_.Cancel(id);
+  }
+
+  // Arms the deadline for `kind` in `room`, replacing the one armed before.
+  void ArmFor(std::string_view room, std::string_view kind,
+              Clock::duration delay) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string key = Key(room, kind);
+    auto it = keyed_.find(key);
+    if (it != keyed_.end()) {
+      wheel_.Cancel(it->second);
+    }
+    keyed_[std::move(key)] = wheel_.Arm(
+        ToTicks(delay), Deadline{std::string(room), std::string(kind)});
+  }
+
+  // Cancels the deadline for `kind` in `room` armed with ArmFor.
+  void CancelFor(std::string_view room, std::string_view kind) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = keyed_.find(Key(room, kind));
+    if (it != keyed_.end()) {
+      wheel_.Cancel(it->second);
+      keyed_.erase(it);
+    }
+  }
+
+  // Returns true if `expired` is the deadline last armed with ArmFor for its
+  // room and kind, and forgets it. False means it was cancelled or armed
+  // again after it fired, and its message is stale.
+  bool Take(const Expired& expired) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = keyed_.find(Key(expired.room, expired.kind));
+    if (it == keyed_.end() || it->second != expired.id) {
+      return false;
+    }
+    keyed_.erase(it);
+    return true;
+  }
+
+  // Cancels the deadlines for `kind` in every room armed with ArmFor.
+  void CancelAllFor(std::string_view kind) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string suffix = "|" + std::string(kind);
+    std::erase_if(keyed_, [this, &suffix](const auto& entry) {
+      if (!entry.first.ends_with(suffix)) {
+        return false;
+      }
+      wheel_.Cancel(entry.second);
+      return true;
+    });
+  }
+
+ private:
+  struct Deadline {
+    std::string room;
+    std::string kind;
+  };
+
+  static std::string Key(std::string_view room, std::string_view kind) {
+    std::string key(room);
+    key += '|';
+    key += kind;
+    return key;
+  }
+
+  // The wheel counts from its last tick, which can be up to a tick behind
+  // now, so one more tick keeps a deadline from firing early.
+  uint64_t ToTicks(Clock::duration delay) const {
+    return static_cast<uint64_t>((delay + resolution_ - Clock::duration(1)) /
+                                 resolution_) +
+           1;
+  }
+
+  void ScheduleTick() {
+    timer_.expires_after(resolution_);
+    timer_.async_wait([this](const boost::system::error_code& ec) {
+      if (ec) {
+        return;
+      }
+      OnTick();
+      ScheduleTick();
+    });
+  }
+
+  void OnTick() {
+    std::vector<std::pair<TimerId, Deadline>> expired;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      uint64_t tick = (Clock::now() - epoch_) / resolution_;
+      // Fired deadlines stay in keyed_ until Take, so a CancelFor or ArmFor
+      // while the message is queued makes it stale.
+      wheel_.Advance(tick, [&expired](TimerId id, Deadline deadline) {
+        expired.emplace_back(id, std::move(deadline));
+      });
+    }
+    for (const auto& [id, deadline] : expired) {
+      deliver_("|deadline|" + deadline.room + "|" + deadline.kind + "|" +
+               std::to_string(id));
+    }
+  }
+
+  boost::asio::steady_timer timer_;
+  DeliverFn deliver_;
+  Clock::duration resolution_;
+  Clock::time_point epoch_;
+  std::mutex mutex_;
+  util::TimerWheel<Deadline> wheel_;
+  std::unordered_map<std::string, TimerId> keyed_;
+};
+
+}  // namespace ps_client
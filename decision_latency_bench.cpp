@@ -0,0 +1,218 @@
+// Replays battle frames through the client's message handling under each
+// thread layout and reports the frame-to-command latency of the choices.
+//
+// An io_context thread queues a battle frame with a request for each room,
+// like the websocket reader, and the handler runs InBattleState on it. A
+// bot thread answers every request it sees on the FIFO, either as a bot
+// command (">ROOM move 1") or as an asynchronous plugin choice
+// ("|choice|ROOM|move 1"). Choices go through an OutboundScheduler on the
+// io_context, which records the latency when it hands them to the socket.
+// The next frame for a room is queued once its choice is sent.
+//
+// Usage: decision_latency_bench [decisions] [layout...]
+//
+// Layouts are --threads specs. Without any, a few common ones are run.
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "challenge_admission.h"
+#include "deadline_timers.h"
+#include "in_battle_state.h"
+#include "inbound_traffic.h"
+#include "latency_histogram.h"
+#include "message_handler.h"
+#include "outbound_scheduler.h"
+#include "shared_queue.h"
+#include "showdown_state_machine.h"
+#include "thread_layout.h"
+
+namespace {
+
+namespace net = boost::asio;
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kRooms = 4;
+
+enum class Bot {
+  // Answers through the FIFO as ">ROOM move 1".
+  kFifo,
+  // Answers like a decision plugin completing asynchronously.
+  kAsyncPlugin,
+};
+
+std::string_view BotName(Bot bot) {
+  return bot == Bot::kFifo ? "fifo" : "async-plugin";
+}
+
+// A turn of a battle followed by the request for the next one.
+std::string BattleFrame(std::string_view room, uint64_t turn) {
+  std::string frame = ">" + std::string(room) + "\n";
+  frame += "|\n|t:|1700000000\n";
+  frame += "|move|p2a: Garchomp|Earthquake|p1a: Heatran\n";
+  frame += "|-supereffective|p1a: Heatran\n";
+  frame += "|-damage|p1a: Heatran|12/100\n";
+  frame += "|move|p1a: Heatran|Earth Power|p2a: Garchomp\n";
+  frame += "|-immune|p2a: Garchomp\n";
+  frame += "|upkeep\n|turn|" + std::to_string(turn) + "\n";
+  frame +=
+      "|request|{\"active\":[{\"moves\":[{\"move\":\"Magma Storm\","
+      "\"id\":\"magmastorm\",\"pp\":8,\"maxpp\":8,\"target\":\"normal\"},"
+      "{\"move\":\"Earth Power\",\"id\":\"earthpower\",\"pp\":15,"
+      "\"maxpp\":16,\"target\":\"normal\"}]}],\"side\":{\"name\":\"bench\","
+      "\"id\":\"p1\",\"pokemon\":[{\"ident\":\"p1: Heatran\","
+      "\"details\":\"Heatran\",\"condition\":\"12/100\",\"active\":true}]},"
+      "\"rqid\":" +
+      std::to_string(turn) + "}";
+  return frame;
+}
+
+// Runs `decisions` choices under `layout` and returns their latencies.
+ps_client::LatencyHistogram Run(const ps_client::ThreadLayout& layout,
+                                Bot bot, size_t decisions) {
+  net::io_context ioc;
+  ps_client::InboundQueueConfig queue_config;
+  util::SharedQueueOptions queue_options = queue_config.ToQueueOptions();
+  queue_options.spin_iterations = layout.spin_iterations;
+  auto queue = std::make_shared<util::SharedQueue<std::string>>(queue_options);
+  // Rooms with a request the bot has not answered yet.
+  util::SharedQueue<std::string> requests;
+
+  // The socket side, only touched on the io_context.
+  ps_client::OutboundConfig outbound_config;
+  outbound_config.burst = decisions + 1;
+  outbound_config.interval = Clock::duration(0);
+  ps_client::OutboundScheduler outbound(outbound_config);
+  std::vector<uint64_t> turns(kRooms, 0);
+  size_t sent = 0;
+
+  auto rooms = [](size_t i) { return "battle-bench-" + std::to_string(i); };
+  auto queue_frame = [&](size_t room) {
+    queue->Enqueue(BattleFrame(rooms(room), ++turns[room]),
+                   ps_client::ToTrafficClass(ps_client::InboundClass::kBattle));
+  };
+
+  ps_client::WebsocketState context(
+      [](const std::string&) {},
+      [&requests](const std::string& line) {
+        // Room tagged lines: ">ROOM\n|HEADER|CONTENTS".
+        size_t newline = line.find('\n');
+        if (line.compare(newline + 1, 9, "|request|") == 0) {
+          requests.Enqueue(line.substr(1, newline - 1));
+        }
+      },
+      [](std::string_view, const std::string&) {});
+  context.fifo_room_tags = true;
+  context.choice_write = [&](std::string_view room, const std::string& message,
+                             std::optional<Clock::time_point> requested_at) {
+    net::post(ioc, [&, room = std::string(room), message, requested_at] {
+      Clock::time_point now = Clock::now();
+      outbound.Push(room + "|" + message, ps_client::ClassifyCommand(message),
+                    now, requested_at);
+      Clock::time_point retry_at;
+      outbound.Pop(now, &retry_at);
+      if (++sent >= decisions) {
+        queue->Close();
+        requests.Close();
+        ioc.stop();
+        return;
+      }
+      queue_frame(std::stoul(room.substr(room.rfind('-') + 1)));
+    });
+  };
+  context.timers = std::make_shared<ps_client::DeadlineTimers>(
+      ioc, [&queue](const std::string& message) {
+        queue->Enqueue(message, ps_client::ToTrafficClass(
+                                    ps_client::InboundClass::kCritical));
+      });
+  context.timers->Start();
+
+  auto admission = std::make_shared<ps_client::ChallengeAdmission>();
+  for (size_t i = 0; i < kRooms; ++i) {
+    admission->RestoreBattle(rooms(i));
+  }
+  ps_client::ShowdownClientStateMachine state_machine(&context);
+  state_machine.AddState(ps_client::ShowdownClientStateEnum::kInBattle,
+                         std::make_unique<ps_client::InBattleState>(admission));
+  state_machine.Start(ps_client::ShowdownClientStateEnum::kInBattle);
+  ps_client::MessageHandler handler(&state_machine, queue);
+
+  std::thread responder([&layout, &requests, &queue, bot] {
+    ps_client::PinCurrentThread(layout.fifo_cpu);
+    while (std::optional<std::string> room = requests.Dequeue()) {
+      std::string answer = bot == Bot::kFifo
+                               ? ">" + *room + " move 1"
+                               : "|choice|" + *room + "|move 1";
+      queue->Enqueue(answer, ps_client::ToTrafficClass(
+                                 ps_client::InboundClass::kBotCommand));
+    }
+  });
+  for (size_t i = 0; i < kRooms; ++i) {
+    net::post(ioc, [&queue_frame, i] { queue_frame(i); });
+  }
+  std::thread io;
+  if (!layout.single_thread) {
+    io = std::thread([&ioc, &layout] {
+      ps_client::PinCurrentThread(layout.io_cpu);
+      ps_client::RunIoContext(ioc, layout.busy_poll);
+    });
+  }
+  ps_client::PinCurrentThread(layout.handler_cpu);
+  if (layout.single_thread) {
+    handler.RunPolling(ioc);
+  } else {
+    handler.Run();
+  }
+  if (io.joinable()) {
+    io.join();
+  }
+  responder.join();
+  return outbound.FrameToCommand();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t decisions = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+  if (decisions == 0) {
+    std::cerr << "Usage: " << argv[0] << " [decisions] [layout...]"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::vector<std::string> specs(argv + std::min(argc, 2), argv + argc);
+  if (specs.empty()) {
+    specs = {"", "spin:100000", "busy-poll,spin:100000", "single-thread"};
+    if (std::thread::hardware_concurrency() >= 3) {
+      specs.push_back("io:0,handler:1,fifo:2,busy-poll,spin:100000");
+    }
+  }
+
+  for (const std::string& spec : specs) {
+    std::optional<ps_client::ThreadLayout> layout =
+        ps_client::ThreadLayout::Parse(spec);
+    if (!layout.has_value()) {
+      return EXIT_FAILURE;
+    }
+    for (Bot bot : {Bot::kFifo, Bot::kAsyncPlugin}) {
+      // The handler logs every message; keep that out of the measurement.
+      std::streambuf* log = std::cout.rdbuf(nullptr);
+      ps_client::LatencyHistogram latency = Run(*layout, bot, decisions);
+      std::cout.rdbuf(log);
+      std::cout.clear();
+      std::cout << "layout=" << (spec.empty() ? "default" : spec)
+                << " bot=" << BotName(bot) << " frame_to_command ";
+      latency.Print(std::cout);
+      std::cout << std::endl;
+    }
+  }
+  return EXIT_SUCCESS;
+}
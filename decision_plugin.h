@@ -0,0 +1,118 @@
+#pragma once
+
+#include <dlfcn.h>
+
+#include <array>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "decision_plugin_abi.h"
+
+namespace ps_client {
+
+// Battle decisions made by a plugin loaded with dlopen, instead of the bot
+// reached through the FIFO.
+class DecisionPlugin {
+ public:
+  // Receives choices the plugin completes asynchronously. Can be called from
+  // any thread.
+  using ChoiceCallback =
+      std::function<void(std::string_view room, std::string_view choice)>;
+
+  // Loads the plugin at `path`. Returns nullptr if it cannot be loaded.
+  static std::unique_ptr<DecisionPlugin> Load(const std::string& path,
+                                              const std::string& config,
+                                              ChoiceCallback on_async_choice) {
+    void* handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle == nullptr) {
+      std::cerr << "dlopen: " << dlerror() << std::endl;
+      return nullptr;
+    }
+    auto entry = reinterpret_cast<ps_decision_plugin_entry_fn>(
+        dlsym(handle, PS_DECISION_PLUGIN_ENTRY));
+    const ps_decision_plugin* table = entry != nullptr ? entry() : nullptr;
+    if (table == nullptr ||
+        table->abi_version != PS_DECISION_PLUGIN_ABI_VERSION) {
+      std::cerr << "Incompatible decision plugin: " << path << std::endl;
+      dlclose(handle);
+      return nullptr;
+    }
+    void* instance = table->create(config.c_str());
+    if (instance == nullptr) {
+      std::cerr << "Decision plugin failed to start: " << path << std::endl;
+      dlclose(handle);
+      return nullptr;
+    }
+    return std::unique_ptr<DecisionPlugin>(new DecisionPlugin(
+        handle, table, instance, std::move(on_async_choice)));
+  }
+
+  DecisionPlugin(const DecisionPlugin&) = delete;
+  DecisionPlugin& operator=(const DecisionPlugin&) = delete;
+
+  ~DecisionPlugin() {
+    table_->destroy(instance_);
+    dlclose(handle_);
+  }
+
+  // Appends a line to the frame passed to the next Decide call.
+  void AddLine(std::string_view header, std::string_view contents) {
+    lines_.push_back(ps_battle_line{{header.data(), header.size()},
+                                    {contents.data(), contents.size()}});
+  }
+
+  // Passes the lines added since the last call to the plugin. Returns the
+  // choice if the plugin made one synchronously, or "default" if it did not
+  // fit in the choice buffer.
+  std::optional<std::string> Decide(std::string_view room) {
+    size_t choice_size = 0;
+    int status = table_->on_battle_lines(
+        instance_, {room.data(), room.size()}, lines_.data(), lines_.size(),
+        choice_.data(), choice_.size(), &choice_size, &OnChoice, this);
+    lines_.clear();
+    if (status == PS_DECISION_ERROR) {
+      std::cerr << "Decision plugin failed for " << room << std::endl;
+    }
+    if (status != PS_DECISION_READY) {
+      return std::nullopt;
+    }
+    if (choice_size > choice_.size()) {
+      std::cerr << "Decision plugin choice of " << choice_size
+                << " bytes for " << room << " does not fit in "
+                << choice_.size() << ", sending the default choice"
+                << std::endl;
+      return "default";
+    }
+    return std::string(choice_.data(), choice_size);
+  }
+
+ private:
+  DecisionPlugin(void* handle, const ps_decision_plugin* table, void* instance,
+                 ChoiceCallback on_async_choice)
+      : handle_(handle),
+        table_(table),
+        instance_(instance),
+        on_async_choice_(std::move(on_async_choice)) {}
+
+  static void OnChoice(void* callback_data, ps_string_view room,
+                       ps_string_view choice) {
+    auto* plugin = static_cast<DecisionPlugin*>(callback_data);
+    plugin->on_async_choice_(std::string_view(room.data, room.size),
+                             std::string_view(choice.data, choice.size));
+  }
+
+  void* handle_;
+  const ps_decision_plugin* table_;
+  void* instance_;
+  ChoiceCallback on_async_choice_;
+  // Reused between calls so deciding does not allocate.
+  std::vector<ps_battle_line> lines_;
+  std::array<char, 256> choice_;
+};
+
+}  // namespace ps_client
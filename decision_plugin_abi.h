@@ -0,0 +1,71 @@
+/* C ABI for in-process battle decision plugins.
+ *
+ * A plugin is a shared library exporting PS_DECISION_PLUGIN_ENTRY, which
+ * returns a static ps_decision_plugin table. The client calls
+ * on_battle_lines with the lines of every battle frame. The plugin either
+ * writes a choice ("move 1", "switch 3", "team 123456", ...) into the buffer
+ * it is given, sets *choice_size to its length and returns
+ * PS_DECISION_READY, or returns PS_DECISION_PENDING and later calls the
+ * completion callback exactly once, from any thread. A choice longer than
+ * choice_capacity is not sent; the client sends the default choice instead.
+ *
+ * All views passed to the plugin are only valid for the duration of the call
+ * they are passed to. This header must stay valid C.
+ */
+#ifndef PS_DECISION_PLUGIN_ABI_H_
+#define PS_DECISION_PLUGIN_ABI_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PS_DECISION_PLUGIN_ABI_VERSION 1
+#define PS_DECISION_PLUGIN_ENTRY "ps_decision_plugin_entry"
+
+typedef struct ps_string_view {
+  const char* data;
+  size_t size;
+} ps_string_view;
+
+/* One "|header|contents" line of a battle frame. */
+typedef struct ps_battle_line {
+  ps_string_view header;
+  ps_string_view contents;
+} ps_battle_line;
+
+typedef enum ps_decision_status {
+  PS_DECISION_ERROR = -1,
+  /* Nothing to decide for this frame. */
+  PS_DECISION_NONE = 0,
+  /* The choice was written to the choice buffer. */
+  PS_DECISION_READY = 1,
+  /* The choice will be delivered through the completion callback. */
+  PS_DECISION_PENDING = 2,
+} ps_decision_status;
+
+typedef void (*ps_choice_callback)(void* callback_data, ps_string_view room,
+                                   ps_string_view choice);
+
+typedef struct ps_decision_plugin {
+  /* Must be PS_DECISION_PLUGIN_ABI_VERSION. */
+  uint32_t abi_version;
+  /* Creates an instance from a plugin specific config string. */
+  void* (*create)(const char* config);
+  void (*destroy)(void* instance);
+  int (*on_battle_lines)(void* instance, ps_string_view room,
+                         const ps_battle_line* lines, size_t line_count,
+                         char* choice, size_t choice_capacity,
+                         size_t* choice_size, ps_choice_callback callback,
+                         void* callback_data);
+} ps_decision_plugin;
+
+typedef const ps_decision_plugin* (*ps_decision_plugin_entry_fn)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PS_DECISION_PLUGIN_ABI_H_ */
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#include "dex_tables.h"
+#include "perfect_hash.h"
+
+namespace dex {
+
+// Dense 16-bit ids for names in the Showdown data tables. kUnknown is used
+// for names missing from the snapshot in dex/data.
+enum class SpeciesId : uint16_t { kUnknown = 0 };
+enum class MoveId : uint16_t { kUnknown = 0 };
+enum class ItemId : uint16_t { kUnknown = 0 };
+enum class AbilityId : uint16_t { kUnknown = 0 };
+
+constexpr SpeciesId ToSpeciesId(std::string_view name) {
+  return static_cast<SpeciesId>(kSpecies.Lookup(name));
+}
+constexpr MoveId ToMoveId(std::string_view name) {
+  return static_cast<MoveId>(kMoves.Lookup(name));
+}
+constexpr ItemId ToItemId(std::string_view name) {
+  return static_cast<ItemId>(kItems.Lookup(name));
+}
+constexpr AbilityId ToAbilityId(std::string_view name) {
+  return static_cast<AbilityId>(kAbilities.Lookup(name));
+}
+
+constexpr std::string_view Name(SpeciesId id) {
+  return kSpecies.Name(static_cast<uint16_t>(id));
+}
+constexpr std::string_view Name(MoveId id) {
+  return kMoves.Name(static_cast<uint16_t>(id));
+}
+constexpr std::string_view Name(ItemId id) {
+  return kItems.Name(static_cast<uint16_t>(id));
+}
+constexpr std::string_view Name(AbilityId id) {
+  return kAbilities.Name(static_cast<uint16_t>(id));
+}
+
+static_assert(Name(ToSpeciesId("Kommo-o")) == "Kommo-o");
+static_assert(ToMoveId("not a move") == MoveId::kUnknown);
+static_assert(Name(ToSpeciesId("nidoking")) == "Nidoking");
+static_assert(Name(ToMoveId("Tackle")) == "Tackle");
+static_assert(ToMoveId("10000000voltthunderbolt") != MoveId::kUnknown);
+
+}  // namespace dex
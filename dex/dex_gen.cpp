@@ -0,0 +1,211 @@
+// Generates constexpr perfect hash tables from the name lists in dex/data.
+//
+// Usage: dex_gen <output header> <TableName>=<names file>...
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "perfect_hash.h"
+
+namespace {
+
+// Names per bucket on average, and spare slots in percent.
+constexpr size_t kBucketSize = 4;
+constexpr size_t kSpareSlotsPercent = 10;
+
+struct Table {
+  std::string name;
+  std::vector<std::string> names;
+  std::vector<std::string> ids;
+  std::vector<uint16_t> displacements;
+  std::vector<uint16_t> slots;
+};
+
+std::string ToId(const std::string& name) {
+  std::string id;
+  for (char c : name) {
+    char id_char = dex::ToIdChar(c);
+    if (id_char != '\0') {
+      id += id_char;
+    }
+  }
+  return id;
+}
+
+bool ReadNames(const std::string& path, Table& table) {
+  std::ifstream file(path);
+  if (!file) {
+    std::cerr << "dex_gen: cannot open " << path << std::endl;
+    return false;
+  }
+  std::unordered_set<std::string> seen;
+  std::string line;
+  while (std::getline(file, line)) {
+    while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) {
+      line.pop_back();
+    }
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::string id = ToId(line);
+    if (id.empty() || !seen.insert(id).second) {
+      std::cerr << "dex_gen: " << path << ": duplicate or empty id for \""
+                << line << "\"" << std::endl;
+      return false;
+    }
+    table.names.push_back(line);
+    table.ids.push_back(id);
+  }
+  if (table.names.size() >= std::numeric_limits<uint16_t>::max()) {
+    std::cerr << "dex_gen: " << path << ": too many names" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Finds a displacement for every bucket, largest buckets first.
+bool Build(Table& table) {
+  size_t n = table.ids.size();
+  size_t num_buckets = std::max<size_t>(1, (n + kBucketSize - 1) / kBucketSize);
+  size_t num_slots = std::max<size_t>(1, n + n * kSpareSlotsPercent / 100);
+
+  std::vector<uint64_t> hashes(n);
+  std::vector<std::vector<size_t>> buckets(num_buckets);
+  for (size_t i = 0; i < n; ++i) {
+    hashes[i] = dex::HashId(table.ids[i]);
+    buckets[dex::BucketOf(hashes[i], num_buckets)].push_back(i);
+  }
+  std::vector<size_t> order(num_buckets);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&buckets](size_t a, size_t b) {
+    return buckets[a].size() > buckets[b].size();
+  });
+
+  table.displacements.assign(num_buckets, 0);
+  table.slots.assign(num_slots, 0);
+  std::vector<size_t> candidate;
+  for (size_t bucket : order) {
+    if (buckets[bucket].empty()) {
+      break;
+    }
+    bool placed = false;
+    for (uint32_t d = 0; d <= std::numeric_limits<uint16_t>::max() && !placed;
+         ++d) {
+      candidate.clear();
+      placed = true;
+      for (size_t i : buckets[bucket]) {
+        size_t slot =
+            dex::SlotOf(hashes[i], static_cast<uint16_t>(d), num_slots);
+        if (table.slots[slot] != 0 ||
+            std::find(candidate.begin(), candidate.end(), slot) !=
+                candidate.end()) {
+          placed = false;
+          break;
+        }
+        candidate.push_back(slot);
+      }
+      if (placed) {
+        table.displacements[bucket] = static_cast<uint16_t>(d);
+        for (size_t k = 0; k < candidate.size(); ++k) {
+          table.slots[candidate[k]] =
+              static_cast<uint16_t>(buckets[bucket][k] + 1);
+        }
+      }
+    }
+    if (!placed) {
+      std::cerr << "dex_gen: no displacement found for " << table.name
+                << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string Quote(const std::string& text) {
+  std::string quoted = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+    }
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+
+void WriteTable(std::ostream& out, const Table& table) {
+  auto write_list = [&out](const auto& values, auto format) {
+    out << "    {";
+    for (size_t i = 0; i < values.size(); ++i) {
+      out << (i % 8 == 0 ? "\n        " : " ") << format(values[i]) << ",";
+    }
+    out << "\n    },\n";
+  };
+  auto quote = [](const std::string& s) { return Quote(s); };
+  auto number = [](uint16_t v) { return std::to_string(v); };
+
+  std::vector<std::string> names = {""};
+  names.insert(names.end(), table.names.begin(), table.names.end());
+  std::vector<std::string> ids = {""};
+  ids.insert(ids.end(), table.ids.begin(), table.ids.end());
+
+  out << "inline constexpr PerfectHashTable<" << table.names.size() << ", "
+      << table.displacements.size() << ", " << table.slots.size() << "> k"
+      << table.name << "{\n";
+  write_list(names, quote);
+  write_list(ids, quote);
+  write_list(table.displacements, number);
+  write_list(table.slots, number);
+  out << "};\n\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0]
+              << " <output header> <TableName>=<names file>..." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<Table> tables;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto equals = arg.find('=');
+    if (equals == std::string::npos) {
+      std::cerr << "dex_gen: expected <TableName>=<names file>: " << arg
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+    Table& table = tables.emplace_back();
+    table.name = arg.substr(0, equals);
+    if (!ReadNames(arg.substr(equals + 1), table) || !Build(table)) {
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::ostringstream out;
+  out << "// Generated by dex_gen from dex/data. Do not edit.\n"
+         "#pragma once\n\n"
+         "#include \"perfect_hash.h\"\n\n"
+         "namespace dex {\n\n";
+  for (const Table& table : tables) {
+    WriteTable(out, table);
+  }
+  out << "}  // namespace dex\n";
+
+  std::ofstream file(argv[1]);
+  file << out.str();
+  if (!file) {
+    std::cerr << "dex_gen: cannot write " << argv[1] << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
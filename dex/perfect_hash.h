@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace dex {
+
+// Names are looked up by their Showdown id: lowercase letters and digits
+// only, so "Kommo-o", "kommoo" and "KOMMO O" are the same name.
+constexpr char ToIdChar(char c) {
+  if (c >= 'A' && c <= 'Z') {
+    return static_cast<char>(c - 'A' + 'a');
+  }
+  if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) {
+    return c;
+  }
+  return '\0';
+}
+
+constexpr uint32_t Mix32(uint32_t h) {
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+// 64-bit FNV-1a over the id of `name`. The low half picks the bucket, the
+// high half is displaced into a slot.
+constexpr uint64_t HashId(std::string_view name) {
+  uint64_t hash = 14695981039346656037ull;
+  for (char c : name) {
+    char id_char = ToIdChar(c);
+    if (id_char != '\0') {
+      hash ^= static_cast<unsigned char>(id_char);
+      hash *= 1099511628211ull;
+    }
+  }
+  return hash;
+}
+
+constexpr size_t BucketOf(uint64_t hash, size_t num_buckets) {
+  return Mix32(static_cast<uint32_t>(hash)) % num_buckets;
+}
+
+constexpr size_t SlotOf(uint64_t hash, uint16_t displacement,
+                        size_t num_slots) {
+  return Mix32(static_cast<uint32_t>(hash >> 32) ^
+               (displacement * 0x9e3779b9u)) %
+         num_slots;
+}
+
+// True if `name` has the id `id`.
+constexpr bool IdEquals(std::string_view name, std::string_view id) {
+  size_t i = 0;
+  for (char c : name) {
+    char id_char = ToIdChar(c);
+    if (id_char == '\0') {
+      continue;
+    }
+    if (i == id.size() || id[i++] != id_char) {
+      return false;
+    }
+  }
+  return i == id.size();
+}
+
+// Perfect hash from names to dense ids 1..N, with 0 for unknown names, and
+// the reverse tables. Generated by dex_gen (hash and displace): each bucket
+// has a displacement that sends all of its names to distinct free slots.
+template <size_t N, size_t Buckets, size_t Slots>
+struct PerfectHashTable {
+  // Display name and id of each dense id; entry 0 is the unknown name.
+  std::array<std::string_view, N + 1> names;
+  std::array<std::string_view, N + 1> ids;
+  std::array<uint16_t, Buckets> displacements;
+  // Dense id in each slot, 0 if free.
+  std::array<uint16_t, Slots> slots;
+
+  constexpr uint16_t Lookup(std::string_view name) const {
+    uint64_t hash = HashId(name);
+    uint16_t displacement = displacements[BucketOf(hash, Buckets)];
+    uint16_t id = slots[SlotOf(hash, displacement, Slots)];
+    return id != 0 && IdEquals(name, ids[id]) ? id : 0;
+  }
+
+  constexpr std::string_view Name(uint16_t id) const {
+    return id <= N ? names[id] : names[0];
+  }
+
+  static constexpr size_t size() { return N; }
+};
+
+}  // namespace dex
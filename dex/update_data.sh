@@ -0,0 +1,49 @@
+#!/bin/sh
+# Syncs the name lists in dex/data with a pokemon-showdown checkout.
+#
+# Usage: dex/update_data.sh PATH_TO_POKEMON_SHOWDOWN
+#
+# Names in the server data that are missing from a list (compared by id) are
+# appended in server order, so existing ids stay put. Names in a list that the
+# server no longer has are reported but kept, since removing them would shift
+# ids.
+set -eu
+
+if [ $# -ne 1 ] || [ ! -d "$1/data" ]; then
+  echo "Usage: $0 PATH_TO_POKEMON_SHOWDOWN" >&2
+  exit 1
+fi
+showdown=$1
+data=$(dirname "$0")/data
+server=$(mktemp)
+trap 'rm -f "$server"' EXIT
+
+# Showdown ids: lowercase a-z0-9, everything else dropped.
+ids='function id(name) { name = tolower(name); gsub(/[^a-z0-9]/, "", name);
+                         return name }'
+
+sync() {
+  list=$data/$1
+  # The top-level `name: "..."` entries of the server table.
+  sed -n 's/^\t\tname: "\(.*\)",$/\1/p' "$showdown/data/$2" > "$server"
+  awk "$ids"'
+    FNR == NR { if ($0 !~ /^#/ && $0 != "") listed[id($0)] = $0; next }
+    !(id($0) in listed) && !(id($0) in seen) { print; seen[id($0)] }
+  ' "$list" "$server" > "$server.missing"
+  awk "$ids"'
+    FNR == NR { known[id($0)]; next }
+    $0 !~ /^#/ && $0 != "" && !(id($0) in known) {
+      print FILENAME ": not in '"$2"': " $0 > "/dev/stderr"
+    }
+  ' "$server" "$list"
+  if [ -s "$server.missing" ]; then
+    cat "$server.missing" >> "$list"
+    echo "$1: appended $(wc -l < "$server.missing") names"
+  fi
+  rm -f "$server.missing"
+}
+
+sync species.txt pokedex.ts
+sync moves.txt moves.ts
+sync items.txt items.ts
+sync abilities.txt abilities.ts
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -16,9 +17,11 @@
 #include "shared_queue.h"
 
 namespace fifo {
-// Function to read from FIFO
+// Function to read from FIFO. Data is enqueued under `traffic_class` until
+// the queue is closed.
 void ReadFromFIFO(std::string_view fifo_path,
-                  std::shared_ptr<util::SharedQueue<std::string>> data_queue) {
+                  std::shared_ptr<util::SharedQueue<std::string>> data_queue,
+                  size_t traffic_class = 0) {
   // Create the FIFO, remove if it already exists.
   if (std::filesystem::exists(fifo_path)) {
     std::filesystem::remove(fifo_path);
@@ -34,14 +37,22 @@ void ReadFromFIFO(std::string_view fifo_path,
   }
 
   char buffer[1024];
-  while (true) {
+  while (!data_queue->Closed()) {
     ssize_t bytesRead = read(fd, buffer, sizeof(buffer) - 1);
     if (bytesRead > 0) {
+      // The bot ends each command with a newline, which is not part of it.
+      while (bytesRead > 0 &&
+             (buffer[bytesRead - 1] == '\n' || buffer[bytesRead - 1] == '\r')) {
+        --bytesRead;
+      }
+      if (bytesRead == 0) {
+        continue;
+      }
       buffer[bytesRead] = '\0';
       std::string data(buffer);
 
       // Add data to the queue
-      data_queue->Enqueue(data);
+      data_queue->Enqueue(data, traffic_class);
     } else if (bytesRead == 0) {
       // End of file
       std::this_thread::sleep_for(std::chrono::milliseconds(100));
@@ -50,6 +61,10 @@ void ReadFromFIFO(std::string_view fifo_path,
         perror("read");
         break;
       }
+      // The bot is connected but idle. Wait for it, waking up now and then
+      // to see if the queue was closed.
+      pollfd readable{fd, POLLIN, 0};
+      poll(&readable, 1, 100);
     }
   }
 
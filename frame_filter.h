@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "inbound_traffic.h"
+
+namespace ps_client {
+
+enum class FrameAction {
+  kDrop,
+  kPass,
+};
+
+// A subscription rule matched against the room id and first header of a raw
+// frame. Frames without a ">ROOMID" line have the room id "lobby", which is
+// how the server sends lobby and global messages.
+struct FrameRule {
+  // Exact room id, "*" for any room, or a prefix ending in '*' ("battle-*").
+  std::string room;
+  // Exact header of the first line, or "*" for any header.
+  std::string header;
+  FrameAction action = FrameAction::kDrop;
+  // Traffic class for frames passed by this rule.
+  InboundClass route = InboundClass::kOther;
+};
+
+// Default subscriptions: drop chat, joins/leaves and query responses in the
+// lobby and global room before they are copied out of the read buffer.
+inline std::vector<FrameRule> DefaultFrameRules() {
+  std::vector<FrameRule> rules;
+  for (std::string_view header :
+       {"c", "c:", "chat", "j", "J", "l", "L", "n", "N", "queryresponse"}) {
+    rules.push_back(FrameRule{"lobby", std::string(header), FrameAction::kDrop});
+  }
+  return rules;
+}
+
+// Decides whether a raw frame is dropped or passed, and with which traffic
+// class, using only the bytes of the frame. The first matching rule wins;
+// frames matching no rule are passed and classified by ClassifyFrame.
+// Apply is only called from the reading thread, counters can be read from any
+// thread.
+class FrameFilter {
+ public:
+  explicit FrameFilter(std::vector<FrameRule> rules = DefaultFrameRules())
+      : rules_(std::move(rules)),
+        counters_(std::make_unique<Counters[]>(rules_.size() + 1)) {}
+
+  // Returns the traffic class of the frame, or nullopt if it is dropped.
+  std::optional<InboundClass> Apply(std::string_view frame) {
+    std::string_view room = "lobby";
+    std::string_view body = frame;
+    if (!body.empty() && body[0] == '>') {
+      auto newline = body.find('\n');
+      room = body.substr(1, newline - 1);
+      body = newline == std::string_view::npos ? std::string_view{}
+                                               : body.substr(newline + 1);
+    }
+    std::string_view header;
+    if (!body.empty() && body[0] == '|') {
+      header = body.substr(1, body.find_first_of("|\n", 1) - 1);
+    }
+
+    for (size_t i = 0; i < rules_.size(); ++i) {
+      const FrameRule& rule = rules_[i];
+      if (!MatchRoom(rule.room, room) ||
+          !(rule.header == "*" || rule.header == header)) {
+        continue;
+      }
+      if (rule.action == FrameAction::kDrop) {
+        counters_[i].dropped.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+      }
+      counters_[i].passed.fetch_add(1, std::memory_order_relaxed);
+      return rule.route;
+    }
+    counters_[rules_.size()].passed.fetch_add(1, std::memory_order_relaxed);
+    return ClassifyFrame(frame);
+  }
+
+  // Prints the dropped and passed counts for each rule.
+  void PrintStats(std::ostream& os) const {
+    for (size_t i = 0; i <= rules_.size(); ++i) {
+      if (i < rules_.size()) {
+        os << rules_[i].room << "|" << rules_[i].header << ": ";
+      } else {
+        os << "unmatched: ";
+      }
+      os << counters_[i].dropped.load(std::memory_order_relaxed)
+         << " dropped, "
+         << counters_[i].passed.load(std::memory_order_relaxed) << " passed"
+         << std::endl;
+    }
+  }
+
+ private:
+  struct Counters {
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> passed{0};
+  };
+
+  static bool MatchRoom(std::string_view pattern, std::string_view room) {
+    if (pattern == "*") {
+      return true;
+    }
+    if (!pattern.empty() && pattern.back() == '*') {
+      return room.starts_with(pattern.substr(0, pattern.size() - 1));
+    }
+    return pattern == room;
+  }
+
+  std::vector<FrameRule> rules_;
+  // One entry per rule, plus one for frames matching no rule.
+  std::unique_ptr<Counters[]> counters_;
+};
+
+}  // namespace ps_client
@@ -1,37 +1,213 @@
 #pragma once
 
+#include <algorithm>
+#include <memory>
+
+#include "battle_tracker.h"
+#include "challenge_admission.h"
+#include "deadline_timers.h"
 #include "showdown_state_machine.h"
+#include "util.h"
 
 namespace ps_client {
+// Time the bot has to answer a battle request before the default choice is
+// sent for it, well within the server's battle timer.
+inline constexpr std::chrono::seconds kRequestDeadline{90};
+
+// Arms the request deadline for a battle request that needs a choice.
+inline void OnBattleRequest(WebsocketState* context, std::string_view room,
+                            std::string_view request) {
+  if (request.find("\"wait\":true") != std::string::npos) {
+    return;
+  }
+  context->decision_latency.OnRequest(room, context->received_at);
+  if (context->timers) {
+    context->timers->ArmFor(room, "request", kRequestDeadline);
+  }
+}
+
+// Sends `choice` for the pending request of the battle in `room`, e.g.
+// "move 1", and records when it went out.
+inline void SendChoice(WebsocketState* context, std::string_view room,
+                       std::string_view choice) {
+  if (context->timers) {
+    context->timers->CancelFor(room, "request");
+  }
+  std::optional<std::chrono::steady_clock::time_point> requested_at =
+      context->decision_latency.OnChoice(room);
+  std::string message = "/choose " + std::string(choice);
+  if (context->choice_write) {
+    context->choice_write(room, message, requested_at);
+  } else {
+    context->room_write(room, message);
+  }
+  context->session.OnDecisionSent();
+}
+
+// Sends the default choice for a battle request that was not answered in
+// time. A deadline cancelled by a choice while its message was queued is
+// ignored. Returns true if the message was a deadline.
+inline bool HandleDeadline(WebsocketState* context,
+                           const WebsocketMessage& message) {
+  if (message.header != "deadline") {
+    return false;
+  }
+  std::optional<DeadlineTimers::Expired> expired =
+      DeadlineTimers::Parse(message.contents);
+  if (expired.has_value() && expired->kind == "request" && context->timers &&
+      context->timers->Take(*expired)) {
+    std::cout << "[battle] request deadline passed in " << expired->room
+              << std::endl;
+    SendChoice(context, expired->room, "default");
+  }
+  return true;
+}
+
+// Sends a choice the decision plugin completed asynchronously, which comes
+// back through the message queue as "|choice|ROOM|CHOICE". Choices for
+// battles that already ended are dropped. Returns true if the message was a
+// plugin choice.
+inline bool HandlePluginChoice(WebsocketState* context,
+                               const WebsocketMessage& message) {
+  if (message.header != "choice") {
+    return false;
+  }
+  size_t room_end = message.contents.find('|');
+  if (room_end == std::string_view::npos) {
+    return true;
+  }
+  std::string_view room = message.contents.substr(0, room_end);
+  const std::vector<std::string>& rooms = context->session.battle_rooms;
+  if (std::find(rooms.begin(), rooms.end(), room) == rooms.end()) {
+    std::cerr << "Dropping plugin choice for " << room
+              << ", which is not in progress" << std::endl;
+    return true;
+  }
+  SendChoice(context, room, message.contents.substr(room_end + 1));
+  return true;
+}
+
+// Sends a command from the FIFO bot as the choice for its battle. A command
+// without a room goes to the only battle in progress; with several battles
+// it must name its room.
+inline void SendBotCommand(WebsocketState* context, const BotCommand& command) {
+  std::string room = command.room;
+  if (room.empty()) {
+    if (context->session.battle_rooms.size() != 1) {
+      std::cerr << "Dropping command without a room while "
+                << context->session.battle_rooms.size()
+                << " battles are in progress: " << command.command << " "
+                << command.argument << std::endl;
+      return;
+    }
+    room = context->session.battle_rooms.front();
+  }
+  std::cout << "Sending command: " << command.command << " to " << room
+            << std::endl;
+  SendChoice(context, room, command.command + " " + command.argument);
+}
+
+// Forwards the lines of a battle frame to the bot, up to a "win" or "tie"
+// line, after which the room is left, or a "noinit" line for a battle that
+// no longer exists when rejoining it. Each line is sent as
+// "|HEADER|CONTENTS", or with room tags as ">ROOM\n|HEADER|CONTENTS" so the
+// bot can tell battles apart and answer with ">ROOM command argument".
+// With a decision plugin, the lines go to the plugin and its choice is sent
+// to the battle room. Returns true if the battle ended.
+inline bool ForwardBattleMessages(WebsocketState* context,
+                                  const CompoundWebsocketMessage& compound_message) {
+  bool ended = false;
+  for (const WebsocketMessage& message : compound_message.messages) {
+    if (context->battle_tracker) {
+      context->battle_tracker->OnLine(compound_message.room, message);
+    }
+    if (message.header == "win" || message.header == "tie" ||
+        message.header == "noinit") {
+      std::cout << "[battle] finished " << compound_message.room << std::endl;
+      if (message.header != "noinit") {
+        context->room_write(compound_message.room, "/leave");
+      }
+      if (context->timers) {
+        context->timers->CancelFor(compound_message.room, "request");
+      }
+      context->session.RemoveBattleRoom(compound_message.room);
+      context->decision_latency.OnBattleEnded(compound_message.room);
+      if (context->battle_tracker) {
+        context->battle_tracker->OnBattleEnded(compound_message.room);
+      }
+      ended = true;
+      break;
+    }
+    if (message.header == "request") {
+      // Only battles the client plays in send requests, so these are the
+      // rooms to rejoin after a restart.
+      context->session.AddBattleRoom(compound_message.room);
+      OnBattleRequest(context, compound_message.room, message.contents);
+    }
+    if (context->decision_plugin) {
+      context->decision_plugin->AddLine(message.header, message.contents);
+      continue;
+    }
+    std::cout << "Sending message: " << message.header << " "
+              << message.contents << std::endl;
+    // Forward to fifo_write.
+    std::string line = "|" + std::string(message.header) + "|" +
+                       std::string(message.contents);
+    if (context->fifo_room_tags) {
+      line = ">" + std::string(compound_message.room) + "\n" + line;
+    }
+    context->fifo_write(line);
+  }
+  if (context->decision_plugin) {
+    std::optional<std::string> choice =
+        context->decision_plugin->Decide(compound_message.room);
+    if (choice.has_value() && !ended) {
+      SendChoice(context, compound_message.room, choice.value());
+    }
+  }
+  return ended;
+}
+
 class InBattleState : public ShowdownClientStateMachine::StateAction {
  public:
+  explicit InBattleState(std::shared_ptr<ChallengeAdmission> admission)
+      : admission_(std::move(admission)) {}
+
   ShowdownClientStateEnum NextState(
       ShowdownClientStateMachine::ContextType* context) override {
     if (std::holds_alternative<CompoundWebsocketMessage>(
             context->last_message)) {
-      CompoundWebsocketMessage compound_message =
+      const CompoundWebsocketMessage& compound_message =
           std::get<CompoundWebsocketMessage>(context->last_message);
-      for (const WebsocketMessage& message : compound_message.messages) {
-        // If the header is "win", go back to lobby state.
-        if (message.header == "win") {
-          std::cout << "Returning to lobby" << std::endl;
-          return ShowdownClientStateEnum::kJoinLobby;
-        } else {
-          std::cout << "Sending message: " << message.header << " "
-                    << message.contents << std::endl;
-          // Forward to fifo_write.
-          context->fifo_write("|" + std::string(message.header) + "|" +
-                              std::string(message.contents));
-        }
+      // Only frames of battles in progress are forwarded. When the battle is
+      // won, free its slot. Go back to lobby state once no battles are left.
+      if (admission_->OnBattleFrame(compound_message) &&
+          ForwardBattleMessages(context, compound_message)) {
+        admission_->OnBattleEnded(compound_message.room);
+      }
+    } else if (std::holds_alternative<WebsocketMessage>(
+                   context->last_message)) {
+      WebsocketMessage message =
+          std::get<WebsocketMessage>(context->last_message);
+      if (message.header == "pm") {
+        HandleChallenge(context, *admission_, message);
+      } else if (!HandleDeadline(context, message)) {
+        HandlePluginChoice(context, message);
       }
     } else if (std::holds_alternative<BotCommand>(context->last_message)) {
-      std::cout << "Sending command: "
-                << std::get<BotCommand>(context->last_message).command
-                << std::endl;
-      BotCommand command = std::get<BotCommand>(context->last_message);
-      context->socket_write(command.command);
+      SendBotCommand(context, std::get<BotCommand>(context->last_message));
+    }
+
+    // Accept queued challenges as battle slots free up.
+    AdmitChallenges(context, *admission_);
+    if (admission_->ActiveBattles() == 0) {
+      std::cout << "Returning to lobby" << std::endl;
+      return ShowdownClientStateEnum::kJoinLobby;
     }
     return ShowdownClientStateEnum::kInBattle;
   }
+
+ private:
+  std::shared_ptr<ChallengeAdmission> admission_;
 };
 }  // namespace ps_client
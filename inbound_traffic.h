@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string_view>
+
+#include "shared_queue.h"
+
+namespace ps_client {
+
+// Traffic classes for frames entering the shared message queue.
+enum class InboundClass : size_t {
+  // Login, private messages and challenges. Never shed.
+  kCritical,
+  // Frames for a battle room. Never shed.
+  kBattle,
+  // Teams and commands from the bot FIFO. Never shed.
+  kBotCommand,
+  // Chat lines in the lobby or other chat rooms.
+  kLobbyChat,
+  // Joins, leaves, renames and user list updates.
+  kUserList,
+  // Anything else the server sends.
+  kOther,
+  kCount,
+};
+
+static_assert(static_cast<size_t>(InboundClass::kCount) <=
+              util::kMaxTrafficClasses);
+
+constexpr size_t ToTrafficClass(InboundClass inbound_class) {
+  return static_cast<size_t>(inbound_class);
+}
+
+constexpr std::string_view InboundClassName(InboundClass inbound_class) {
+  switch (inbound_class) {
+    case InboundClass::kCritical:
+      return "critical";
+    case InboundClass::kBattle:
+      return "battle";
+    case InboundClass::kBotCommand:
+      return "bot_command";
+    case InboundClass::kLobbyChat:
+      return "lobby_chat";
+    case InboundClass::kUserList:
+      return "user_list";
+    case InboundClass::kOther:
+      return "other";
+    default:
+      return "unknown";
+  }
+}
+
+// Capacity and shedding classes for the inbound queue. User list updates are
+// shed first, then lobby chat. Everything else is kept by default.
+struct InboundQueueConfig {
+  size_t capacity = 4096;
+  uint8_t lobby_chat_shed_priority = 1;
+  uint8_t user_list_shed_priority = 2;
+  uint8_t other_shed_priority = 0;
+
+  util::SharedQueueOptions ToQueueOptions() const {
+    util::SharedQueueOptions options;
+    options.capacity = capacity;
+    options.shed_priority[ToTrafficClass(InboundClass::kLobbyChat)] =
+        lobby_chat_shed_priority;
+    options.shed_priority[ToTrafficClass(InboundClass::kUserList)] =
+        user_list_shed_priority;
+    options.shed_priority[ToTrafficClass(InboundClass::kOther)] =
+        other_shed_priority;
+    return options;
+  }
+};
+
+// Classifies a raw server frame by its room and the header of its first line.
+inline InboundClass ClassifyFrame(std::string_view frame) {
+  std::string_view body = frame;
+  if (!body.empty() && body[0] == '>') {
+    auto newline = body.find('\n');
+    std::string_view room = body.substr(1, newline - 1);
+    if (room.starts_with("battle-")) {
+      return InboundClass::kBattle;
+    }
+    body = newline == std::string_view::npos ? std::string_view{}
+                                             : body.substr(newline + 1);
+  }
+
+  if (body.empty() || body[0] != '|') {
+    return InboundClass::kOther;
+  }
+  auto header_end = body.find_first_of("|\n", 1);
+  std::string_view header = body.substr(1, header_end - 1);
+  if (header == "challstr" || header == "pm" || header == "updateuser" ||
+      header == "updatechallenges" || header == "updatesearch" ||
+      header == "popup" || header == "nametaken") {
+    return InboundClass::kCritical;
+  }
+  if (header == "c" || header == "c:" || header == "chat" || header == "raw" ||
+      header == "html") {
+    return InboundClass::kLobbyChat;
+  }
+  if (header == "j" || header == "J" || header == "join" || header == "l" ||
+      header == "L" || header == "leave" || header == "n" || header == "N" ||
+      header == "name" || header == "users" || header == "usercount") {
+    return InboundClass::kUserList;
+  }
+  return InboundClass::kOther;
+}
+
+// Prints queue depth, peak memory and per class drop counts.
+inline void PrintInboundStats(std::ostream& os,
+                              const util::SharedQueueStats& stats) {
+  os << "depth=" << stats.depth << " peak_depth=" << stats.peak_depth
+     << " bytes=" << stats.bytes << " peak_bytes=" << stats.peak_bytes;
+  for (size_t i = 0; i < static_cast<size_t>(InboundClass::kCount); ++i) {
+    os << " " << InboundClassName(static_cast<InboundClass>(i))
+       << "=" << stats.enqueued[i] << " (" << stats.dropped[i] << " dropped)";
+  }
+  os << std::endl;
+}
+
+}  // namespace ps_client
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <variant>
+
+#include "in_battle_state.h"
+#include "showdown_state_machine.h"
+
+namespace ps_client {
+
+struct LadderConfig {
+  // Format to search for, e.g. "gen9randombattle".
+  std::string format;
+  // Searches plus battles to keep in flight.
+  size_t target_in_flight = 1;
+};
+
+// Keeps `target_in_flight` searches and battles going on the ladder, and
+// searches again as soon as a battle ends. The server allows only one search
+// per format at a time, so at most one search is outstanding and the rest of
+// the target is filled by battles.
+class LadderState : public ShowdownClientStateMachine::StateAction {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit LadderState(LadderConfig config) : config_(std::move(config)) {}
+
+  void EnterState(ShowdownClientStateMachine::ContextType* context) override {
+    started_at_ = Clock::now();
+    // Battles restored from a snapshot are already in flight.
+    for (const std::string& room : context->session.battle_rooms) {
+      battles_.insert(room);
+    }
+    TopUp(context);
+  }
+
+  ShowdownClientStateEnum NextState(
+      ShowdownClientStateMachine::ContextType* context) override {
+    if (std::holds_alternative<CompoundWebsocketMessage>(
+            context->last_message)) {
+      CompoundWebsocketMessage compound_message =
+          std::get<CompoundWebsocketMessage>(context->last_message);
+      if (OnBattleFrame(compound_message) &&
+          ForwardBattleMessages(context, compound_message)) {
+        battles_.erase(std::string(compound_message.room));
+        finished_rooms_.insert(std::string(compound_message.room));
+        ++finished_;
+        PrintStats();
+      }
+    } else if (std::holds_alternative<WebsocketMessage>(
+                   context->last_message)) {
+      WebsocketMessage message =
+          std::get<WebsocketMessage>(context->last_message);
+      if (message.header == "updatesearch") {
+        OnUpdateSearch(message.contents);
+      } else if (!HandleDeadline(context, message)) {
+        HandlePluginChoice(context, message);
+      }
+    } else if (std::holds_alternative<BotCommand>(context->last_message)) {
+      SendBotCommand(context, std::get<BotCommand>(context->last_message));
+    }
+
+    TopUp(context);
+    return ShowdownClientStateEnum::kLadder;
+  }
+
+  void ExitState(ShowdownClientStateMachine::ContextType* context) override {
+    if (searching_) {
+      context->socket_write("/cancelsearch");
+      searching_ = false;
+    }
+  }
+
+ private:
+  // Returns true if the frame belongs to a battle in flight. A battle starts
+  // with its "|init|battle" frame. Frames that still arrive for a room after
+  // its "win" line are ignored.
+  bool OnBattleFrame(const CompoundWebsocketMessage& frame) {
+    std::string room(frame.room);
+    if (!room.starts_with("battle-") || finished_rooms_.contains(room)) {
+      return false;
+    }
+    if (battles_.contains(room)) {
+      return true;
+    }
+    if (!frame.StartsBattle()) {
+      return false;
+    }
+    OnBattleStarted(std::move(room));
+    return true;
+  }
+
+  void OnBattleStarted(std::string room) {
+    if (!battles_.insert(std::move(room)).second) {
+      return;
+    }
+    if (searching_) {
+      searching_ = false;
+      Clock::duration wait = Clock::now() - search_started_at_;
+      ++matched_;
+      total_queue_wait_ += wait;
+    }
+  }
+
+  // Handles {"searching":[...],"games":{"battle-...":"title",...}}. Battles
+  // listed in "games" count as started, which can be before their first
+  // frame. An empty search list with no new battle means the search was
+  // cancelled. Finished rooms are kept for the session, as the server can
+  // still list them or send their frames after the "win" line.
+  void OnUpdateSearch(std::string_view update) {
+    nlohmann::json json = nlohmann::json::parse(update, nullptr, false);
+    if (json.is_discarded() || !json.is_object()) {
+      std::cerr << "Bad updatesearch: " << update << std::endl;
+      return;
+    }
+    if (auto games = json.find("games");
+        games != json.end() && games->is_object()) {
+      for (const auto& [room, title] : games->items()) {
+        if (room.starts_with("battle-") && !finished_rooms_.contains(room)) {
+          OnBattleStarted(room);
+        }
+      }
+    }
+    if (auto searching = json.find("searching");
+        searching != json.end() && searching->is_array() &&
+        searching->empty()) {
+      searching_ = false;
+    }
+  }
+
+  // Sends a search if fewer than the target are in flight.
+  void TopUp(ShowdownClientStateMachine::ContextType* context) {
+    if (searching_ || battles_.size() >= config_.target_in_flight) {
+      return;
+    }
+    context->socket_write("/search " + config_.format);
+    searching_ = true;
+    search_started_at_ = Clock::now();
+  }
+
+  void PrintStats() const {
+    using std::chrono::duration;
+    using std::chrono::duration_cast;
+    using std::chrono::milliseconds;
+    double hours = duration<double, std::ratio<3600>>(Clock::now() - started_at_)
+                       .count();
+    std::cout << "[ladder] battles=" << battles_.size()
+              << " finished=" << finished_;
+    if (hours > 0) {
+      std::cout << " battles_per_hour=" << finished_ / hours;
+    }
+    if (matched_ > 0) {
+      std::cout << " queue_wait_avg_ms="
+                << duration_cast<milliseconds>(total_queue_wait_).count() /
+                       matched_;
+    }
+    std::cout << std::endl;
+  }
+
+  LadderConfig config_;
+  std::unordered_set<std::string> battles_;
+  std::unordered_set<std::string> finished_rooms_;
+  bool searching_ = false;
+  Clock::time_point search_started_at_;
+  Clock::time_point started_at_;
+  uint64_t matched_ = 0;
+  uint64_t finished_ = 0;
+  Clock::duration total_queue_wait_{0};
+};
+}  // namespace ps_client
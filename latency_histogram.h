@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace ps_client {
+
+// Histogram of latencies with buckets a sixteenth of a power of two wide, so
+// percentiles are within about 6% at any scale. Not thread safe.
+class LatencyHistogram {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  void Record(Clock::duration latency) {
+    uint64_t ns = static_cast<uint64_t>(
+        std::max<int64_t>(0, std::chrono::nanoseconds(latency).count()));
+    ++buckets_[BucketOf(ns)];
+    ++count_;
+    max_ns_ = std::max(max_ns_, ns);
+  }
+
+  uint64_t Count() const { return count_; }
+
+  // Upper bound of the bucket holding the `quantile` (0 to 1) latency.
+  std::chrono::nanoseconds Percentile(double quantile) const {
+    if (count_ == 0) {
+      return std::chrono::nanoseconds(0);
+    }
+    uint64_t rank = static_cast<uint64_t>(quantile * (count_ - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets_.size(); ++i) {
+      seen += buckets_[i];
+      if (seen >= rank) {
+        return std::chrono::nanoseconds(std::min(UpperBound(i), max_ns_));
+      }
+    }
+    return std::chrono::nanoseconds(max_ns_);
+  }
+
+  // Prints "count=N p50_us=... p99_us=... p999_us=... max_us=...".
+  void Print(std::ostream& os) const {
+    auto us = [](std::chrono::nanoseconds ns) { return ns.count() / 1000.0; };
+    os << "count=" << count_ << " p50_us=" << us(Percentile(0.5))
+       << " p99_us=" << us(Percentile(0.99))
+       << " p999_us=" << us(Percentile(0.999))
+       << " max_us=" << us(std::chrono::nanoseconds(max_ns_));
+  }
+
+ private:
+  static constexpr int kSubBucketBits = 4;
+  static constexpr uint64_t kSubBuckets = 1 << kSubBucketBits;
+
+  // Values below kSubBuckets get a bucket each; above, each power of two is
+  // split into kSubBuckets buckets.
+  static size_t BucketOf(uint64_t ns) {
+    if (ns < kSubBuckets) {
+      return ns;
+    }
+    int shift = std::bit_width(ns) - 1 - kSubBucketBits;
+    return (shift + 1) * kSubBuckets + ((ns >> shift) - kSubBuckets);
+  }
+
+  static uint64_t UpperBound(size_t bucket) {
+    if (bucket < kSubBuckets) {
+      return bucket;
+    }
+    int shift = static_cast<int>(bucket / kSubBuckets) - 1;
+    uint64_t base = (kSubBuckets + bucket % kSubBuckets) << shift;
+    return base + (uint64_t{1} << shift) - 1;
+  }
+
+  std::array<uint64_t, (64 - kSubBucketBits + 1) * kSubBuckets> buckets_{};
+  uint64_t count_ = 0;
+  uint64_t max_ns_ = 0;
+};
+
+// Battle requests waiting for a choice, for the frame-to-command latency of
+// battle decisions: from the battle frame with a request being queued by the
+// reader to the choice for it being sent on the socket. The choice carries
+// the request time through the outbound queue, so time held back by the rate
+// limit counts, and OutboundScheduler records the latency when it sends the
+// choice. With the FIFO bot this includes the time the bot takes.
+class DecisionLatency {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  void OnRequest(std::string_view room, Clock::time_point received_at) {
+    for (auto& [pending_room, at] : pending_) {
+      if (pending_room == room) {
+        at = received_at;
+        return;
+      }
+    }
+    pending_.emplace_back(std::string(room), received_at);
+  }
+
+  // A choice for the request in `room`. Returns when the request was
+  // received, if one was waiting.
+  std::optional<Clock::time_point> OnChoice(std::string_view room) {
+    for (auto it = pending_.begin(); it != pending_.end(); ++it) {
+      if (it->first == room) {
+        Clock::time_point received_at = it->second;
+        pending_.erase(it);
+        return received_at;
+      }
+    }
+    return std::nullopt;
+  }
+
+  // Drops the request of a battle that ended without a choice.
+  void OnBattleEnded(std::string_view room) {
+    std::erase_if(pending_, [room](const auto& pending) {
+      return pending.first == room;
+    });
+  }
+
+
+ private:
+  std::vector<std::pair<std::string, Clock::time_point>> pending_;
+};
+
+}  // namespace ps_client
@@ -8,7 +8,12 @@
 namespace ps_client {
 class LoginState : public ShowdownClientStateMachine::StateAction {
  public:
-  LoginState(boost::asio::io_context& ioc) : user_login_(ioc) {}
+  // `after_login` is the state to go to once logged in, e.g. kInBattle when
+  // resuming battles restored from a snapshot.
+  LoginState(boost::asio::io_context& ioc,
+             ShowdownClientStateEnum after_login =
+                 ShowdownClientStateEnum::kJoinLobby)
+      : user_login_(ioc), after_login_(after_login) {}
   ShowdownClientStateMachine::StateEnumType NextState(
       ShowdownClientStateMachine::ContextType* context) override {
     if (!std::holds_alternative<WebsocketMessage>(context->last_message)) {
@@ -33,7 +38,15 @@ class LoginState : public ShowdownClientStateMachine::StateAction {
       login_message += user_login_.Login(user_info);
       context->socket_write(login_message);
 
-      return ShowdownClientStateEnum::kJoinLobby;
+      // A restored session uploads its team again and rejoins its battles.
+      // The server replays each battle log and the pending request on join.
+      if (!context->session.team.empty()) {
+        context->socket_write("/utm " + context->session.team);
+      }
+      for (const std::string& room : context->session.battle_rooms) {
+        context->socket_write("/join " + room);
+      }
+      return after_login_;
     }
 
     return ShowdownClientStateEnum::kLoggingIn;
@@ -43,5 +56,6 @@ class LoginState : public ShowdownClientStateMachine::StateAction {
   static constexpr std::string_view kUsername{"bot4352"};
   static constexpr std::string_view kPassword{"p"};
   User user_login_;
+  ShowdownClientStateEnum after_login_;
 };
 }  // namespace ps_client
@@ -1,19 +1,31 @@
 #include <boost/asio/connect.hpp>
 #include <boost/asio/io_context.hpp>
+#include <boost/asio/signal_set.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
+#include <chrono>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <thread>
 
 #include "accept_challenge_state.h"
+#include "challenge_admission.h"
+#include "deadline_timers.h"
 #include "fifo_listener.h"
+#include "frame_filter.h"
 #include "in_battle_state.h"
+#include "inbound_traffic.h"
+#include "ladder_state.h"
 #include "lobby_state.h"
 #include "login_state.h"
+#include "message_handler.h"
+#include "outbound_scheduler.h"
+#include "session_snapshot.h"
 #include "shared_queue.h"
 #include "showdown_state_machine.h"
+#include "thread_layout.h"
 
 namespace beast = boost::beast;          // from <boost/beast.hpp>
 namespace http = beast::http;            // from <boost/beast/http.hpp>
@@ -26,12 +38,17 @@ class WebSocketClient {
  public:
   WebSocketClient(net::io_context& ioc, const std::string& host,
                   const std::string& port,
-                  std::shared_ptr<util::SharedQueue<std::string>> message_queue)
-      : strand_(net::make_strand(ioc)),
-        resolver_(ioc),
+                  std::shared_ptr<util::SharedQueue<std::string>> message_queue,
+                  const ps_client::OutboundConfig& outbound_config = {},
+                  std::vector<ps_client::FrameRule> frame_rules =
+                      ps_client::DefaultFrameRules())
+      : resolver_(ioc),
         ws_(net::make_strand(ioc)),
+        throttle_timer_(ws_.get_executor()),
         host_(host),
-        message_queue_(message_queue) {
+        message_queue_(message_queue),
+        frame_filter_(std::move(frame_rules)),
+        outbound_(outbound_config) {
     // Resolve the hostname and port synchronously
     auto const results = resolver_.resolve(host, port);
 
@@ -45,25 +62,83 @@ class WebSocketClient {
     do_read();
   }
 
-  void write(const std::string& message) {
-    net::dispatch(strand_, [this, message]() {
-      std::cout << "Writing message: " << message << std::endl;
-      std::string prepended = "|";
-      prepended += message;
-      ws_.async_write(
-          net::buffer(prepended),
-          [this](beast::error_code ec, std::size_t bytes_transferred) {
-            on_write(ec, bytes_transferred);
-          });
+  void write(const std::string& message) { write("", message); }
+
+  // Writes a message to a room. An empty room is the global room. Messages
+  // are queued by priority and sent no faster than the server allows. A
+  // battle choice passes when its request was received, for the
+  // frame-to-command latency.
+  void write(std::string_view room, const std::string& message,
+             std::optional<std::chrono::steady_clock::time_point>
+                 requested_at = std::nullopt) {
+    std::string prepended{room};
+    prepended += "|";
+    prepended += message;
+    ps_client::OutboundClass outbound_class =
+        ps_client::ClassifyCommand(message);
+    net::dispatch(ws_.get_executor(), [this, prepended = std::move(prepended),
+                                       outbound_class, requested_at]() mutable {
+      outbound_.Push(std::move(prepended), outbound_class,
+                     std::chrono::steady_clock::now(), requested_at);
+      do_write();
     });
   }
 
+  const ps_client::FrameFilter& frame_filter() const { return frame_filter_; }
+
+  // Only read once the io_context has stopped.
+  const ps_client::OutboundScheduler& outbound() const { return outbound_; }
+
   void close() {
     ws_.async_close(websocket::close_code::normal,
                     [this](beast::error_code ec) { on_close(ec); });
   }
 
  private:
+  // Number of sent messages between outbound metric reports.
+  static constexpr uint64_t kStatsInterval = 100;
+  // Number of read frames between frame filter reports.
+  static constexpr uint64_t kFilterStatsInterval = 1000;
+
+  // Sends the next queued message, one at a time. When the rate limit holds
+  // it back, retries once the limit allows. Runs on the stream's strand.
+  void do_write() {
+    if (writing_) {
+      return;
+    }
+    std::chrono::steady_clock::time_point retry_at;
+    std::optional<std::string> frame =
+        outbound_.Pop(std::chrono::steady_clock::now(), &retry_at);
+    if (!frame.has_value()) {
+      if (!outbound_.Empty() && !throttle_timer_armed_) {
+        throttle_timer_armed_ = true;
+        throttle_timer_.expires_at(retry_at);
+        throttle_timer_.async_wait([this](beast::error_code ec) {
+          throttle_timer_armed_ = false;
+          if (!ec) {
+            do_write();
+          }
+        });
+      }
+      return;
+    }
+    writing_ = true;
+    // The buffer must outlive the write.
+    outgoing_ = std::move(frame.value());
+    std::cout << "Writing message: " << outgoing_ << std::endl;
+    ws_.async_write(
+        net::buffer(outgoing_),
+        [this](beast::error_code ec, std::size_t bytes_transferred) {
+          writing_ = false;
+          on_write(ec, bytes_transferred);
+          if (++sent_ % kStatsInterval == 0) {
+            std::cout << "[outbound] ";
+            outbound_.PrintStats(std::cout);
+          }
+          do_write();
+        });
+  }
+
   void do_read() {
     ws_.async_read(buffer_,
                    [this](beast::error_code ec, std::size_t bytes_transferred) {
@@ -79,9 +154,20 @@ class WebSocketClient {
       return;
     }
 
-    // Get the message from the buffer.
-    std::string message{beast::buffers_to_string(buffer_.data())};
-    message_queue_->Enqueue(message);
+    // Filter on the raw bytes so dropped frames are never copied.
+    std::string_view frame{static_cast<const char*>(buffer_.data().data()),
+                           buffer_.size()};
+    std::optional<ps_client::InboundClass> inbound_class =
+        frame_filter_.Apply(frame);
+    if (inbound_class.has_value()) {
+      message_queue_->Enqueue(std::string(frame),
+                              ps_client::ToTrafficClass(*inbound_class));
+    }
+
+    if (++read_ % kFilterStatsInterval == 0) {
+      std::cout << "[frame filter]" << std::endl;
+      frame_filter_.PrintStats(std::cout);
+    }
 
     // Clear the buffer
     buffer_.consume(buffer_.size());
@@ -108,66 +194,138 @@ class WebSocketClient {
     std::cerr << what << ": " << ec.message() << "\n";
   }
 
-  net::strand<net::io_context::executor_type> strand_;
   tcp::resolver resolver_;
+  // Reads, writes and the outbound queue all run on this stream's strand.
   websocket::stream<tcp::socket> ws_;
+  net::steady_timer throttle_timer_;
+  bool throttle_timer_armed_ = false;
+  bool writing_ = false;
+  std::string outgoing_;
+  uint64_t sent_ = 0;
+  uint64_t read_ = 0;
   beast::flat_buffer buffer_;
   std::string host_;
   std::shared_ptr<util::SharedQueue<std::string>> message_queue_;
+  ps_client::FrameFilter frame_filter_;
+  ps_client::OutboundScheduler outbound_;
 };
 
-// Class that takes Message objects from a queue and calls the StateMachine
-// update.
-// TODO: Use smart pointers / move semantics / factory.
-class MessageHandler {
- public:
-  explicit MessageHandler(
-      ps_client::ShowdownClientStateMachine* state_machine,
-      std::shared_ptr<util::SharedQueue<std::string>> message_queue)
-      : state_machine_(state_machine), message_queue_(message_queue) {}
-
-  void HandleMessage(const std::string& message) {
-    state_machine_->MutableContext()->SetMessage(message);
-    state_machine_->Update();
-  }
-
-  // Runs a loop that reads messages from the queue and calls HandleMessage.
-  void Run() {
-    while (true) {
-      std::optional<std::string> message = message_queue_->Dequeue();
-      if (!message.has_value()) {
-        break;
+int main(int argc, char** argv) {
+  const auto started_at = std::chrono::steady_clock::now();
+  // Options are "--plugin=<path>", "--plugin-config=<config>",
+  // "--snapshot=<path>", "--threads=<layout>",
+  // "--rate-limit=<burst>/<interval ms>" and "--battles=<n>"; the rest are
+  // positional. Snapshots are off unless "--snapshot" names a file, which
+  // should be one per account in a directory only this user can write.
+  std::vector<std::string> args;
+  std::string plugin_path;
+  std::string plugin_config;
+  std::string snapshot_path;
+  ps_client::ThreadLayout thread_layout;
+  ps_client::OutboundConfig outbound_config;
+  // Challenges accepted at the same time.
+  size_t max_battles = 1;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg.starts_with("--plugin=")) {
+      plugin_path = arg.substr(9);
+    } else if (arg.starts_with("--plugin-config=")) {
+      plugin_config = arg.substr(16);
+    } else if (arg.starts_with("--snapshot=")) {
+      snapshot_path = arg.substr(11);
+    } else if (arg.starts_with("--threads=")) {
+      std::optional<ps_client::ThreadLayout> layout =
+          ps_client::ThreadLayout::Parse(arg.substr(10));
+      if (!layout.has_value()) {
+        return EXIT_FAILURE;
+      }
+      thread_layout = layout.value();
+    } else if (arg.starts_with("--rate-limit=")) {
+      // Trusted users may send faster than the default, e.g. "6/100".
+      std::string_view rate = arg.substr(13);
+      size_t slash = rate.find('/');
+      size_t burst = 0;
+      uint32_t interval_ms = 0;
+      if (slash == std::string_view::npos ||
+          !util::ParseNumber(rate.substr(0, slash), burst) || burst == 0 ||
+          !util::ParseNumber(rate.substr(slash + 1), interval_ms)) {
+        std::cerr << "Bad rate limit: " << rate
+                  << ", expected <burst>/<interval ms>" << std::endl;
+        return EXIT_FAILURE;
       }
-      std::cout << "Received message: " << message.value() << std::endl;
-      HandleMessage(message.value());
+      outbound_config.burst = burst;
+      outbound_config.interval = std::chrono::milliseconds(interval_ms);
+    } else if (arg.starts_with("--battles=")) {
+      if (!util::ParseNumber(arg.substr(10), max_battles) ||
+          max_battles == 0) {
+        std::cerr << "Bad number of battles: " << arg.substr(10) << std::endl;
+        return EXIT_FAILURE;
+      }
+    } else {
+      args.emplace_back(arg);
     }
   }
-
- private:
-  ps_client::ShowdownClientStateMachine* state_machine_;
-  std::shared_ptr<util::SharedQueue<std::string>> message_queue_;
-};
-
-int main(int argc, char** argv) {
-  if (argc != 3) {
-    std::cerr << "Usage: " << argv[0] << " <host> <port>\n";
+  if (args.size() < 2 || args.size() > 4) {
+    std::cerr << "Usage: " << argv[0]
+              << " [--plugin=<path>] [--plugin-config=<config>]"
+                 " [--snapshot=<path>] [--threads=<layout>]"
+                 " [--rate-limit=<burst>/<interval ms>] [--battles=<n>]"
+                 " <host> <port> [<ladder format> [<battles in flight>]]\n";
     return EXIT_FAILURE;
   }
-  const std::string host = argv[1];
-  const std::string port = argv[2];
+  const std::string host = args[0];
+  const std::string port = args[1];
+  // Without a ladder format, the client waits for challenges in the lobby.
+  std::optional<ps_client::LadderConfig> ladder_config;
+  if (args.size() > 2) {
+    ladder_config = ps_client::LadderConfig{args[2]};
+    if (args.size() > 3 &&
+        (!util::ParseNumber(args[3], ladder_config->target_in_flight) ||
+         ladder_config->target_in_flight == 0)) {
+      std::cerr << "Bad number of battles in flight: " << args[3] << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
 
+  // Bounded so a stalled consumer sheds lobby traffic instead of growing
+  // without limit.
+  ps_client::InboundQueueConfig queue_config;
+  util::SharedQueueOptions queue_options = queue_config.ToQueueOptions();
+  queue_options.spin_iterations = thread_layout.spin_iterations;
   auto shared_message_queue =
-      std::make_shared<util::SharedQueue<std::string>>();
+      std::make_shared<util::SharedQueue<std::string>>(queue_options);
 
   net::io_context ioc;
-  WebSocketClient client(ioc, host, port, shared_message_queue);
-
-  // Run the I/O context on a separate thread
-  std::thread t([&ioc] { ioc.run(); });
+  WebSocketClient client(ioc, host, port, shared_message_queue,
+                         outbound_config);
+
+  // SIGINT and SIGTERM stop the client, which then prints its stats.
+  net::signal_set signals(ioc, SIGINT, SIGTERM);
+  signals.async_wait([&ioc, &shared_message_queue](beast::error_code ec,
+                                                   int /*signal*/) {
+    if (!ec) {
+      shared_message_queue->Close();
+      ioc.stop();
+    }
+  });
+
+  // Run the I/O context on a separate thread, unless it shares the handler
+  // thread.
+  std::thread t;
+  if (!thread_layout.single_thread) {
+    t = std::thread([&ioc, &thread_layout] {
+      ps_client::PinCurrentThread(thread_layout.io_cpu);
+      ps_client::RunIoContext(ioc, thread_layout.busy_poll);
+    });
+  }
 
   // Start the FIFO listener
-  std::thread fifo_listener(fifo::ReadFromFIFO, "/tmp/ps_fifo",
-                            shared_message_queue);
+  std::thread fifo_listener([&shared_message_queue, &thread_layout] {
+    ps_client::PinCurrentThread(thread_layout.fifo_cpu);
+    fifo::ReadFromFIFO(
+        "/tmp/ps_fifo", shared_message_queue,
+        ps_client::ToTrafficClass(ps_client::InboundClass::kBotCommand));
+  });
 
   // Create the FIFO writer.
   fifo::FIFOWriter fifo_writer("/tmp/fifo_to_bot");
@@ -175,20 +333,105 @@ int main(int argc, char** argv) {
   // Create the state machine
   ps_client::ShowdownClientStateMachine::ContextType context{
       [&client](const std::string& message) { client.write(message); },
-      fifo_writer.GetWriteFn()};
+      fifo_writer.GetWriteFn(),
+      [&client](std::string_view room, const std::string& message) {
+        client.write(room, message);
+      }};
+  context.choice_write =
+      [&client](std::string_view room, const std::string& message,
+                std::optional<std::chrono::steady_clock::time_point>
+                    requested_at) {
+        client.write(room, message, requested_at);
+      };
+  // Expired deadlines come back through the message queue.
+  context.timers = std::make_shared<ps_client::DeadlineTimers>(
+      ioc, [&shared_message_queue](const std::string& message) {
+        shared_message_queue->Enqueue(
+            message,
+            ps_client::ToTrafficClass(ps_client::InboundClass::kCritical));
+      });
+  context.timers->Start();
+  // Bots that only ever play one battle keep the untagged FIFO lines.
+  context.fifo_room_tags =
+      max_battles > 1 ||
+      (ladder_config.has_value() && ladder_config->target_in_flight > 1);
+  context.battle_tracker = std::make_shared<ps_client::BattleTracker>();
+  // Battle decisions are made in process instead of through the FIFO when a
+  // plugin is given. Choices the plugin completes on its own threads are
+  // sent from the handler thread, like the ones it makes synchronously.
+  if (!plugin_path.empty()) {
+    context.decision_plugin = ps_client::DecisionPlugin::Load(
+        plugin_path, plugin_config,
+        [&shared_message_queue](std::string_view room,
+                                std::string_view choice) {
+          shared_message_queue->Enqueue(
+              "|choice|" + std::string(room) + "|" + std::string(choice),
+              ps_client::ToTrafficClass(
+                  ps_client::InboundClass::kBotCommand));
+        });
+    if (!context.decision_plugin) {
+      return EXIT_FAILURE;
+    }
+  }
   ps_client::ShowdownClientStateMachine state_machine(&context);
+  // Challenges are queued and accepted while battle slots are free.
+  ps_client::AdmissionConfig admission_config;
+  admission_config.max_concurrent_battles = max_battles;
+  auto admission =
+      std::make_shared<ps_client::ChallengeAdmission>(admission_config);
+
+  // Resume the session of a client that died, going straight back to its
+  // battles after logging in.
+  std::unique_ptr<ps_client::SessionSnapshot> snapshot;
+  ps_client::ShowdownClientStateEnum after_login =
+      ps_client::ShowdownClientStateEnum::kJoinLobby;
+  if (!snapshot_path.empty()) {
+    snapshot = ps_client::SessionSnapshot::Open(snapshot_path);
+  }
+  if (snapshot) {
+    if (std::optional<ps_client::SavedSession> saved = snapshot->Load()) {
+      std::cout << "[resume] team=" << !saved->team.empty()
+                << " battles=" << saved->battle_rooms.size() << std::endl;
+      context.session.team = std::move(saved->team);
+      context.session.battle_rooms = std::move(saved->battle_rooms);
+      if (!context.session.battle_rooms.empty()) {
+        context.session.resumed_at = started_at;
+        for (const std::string& room : context.session.battle_rooms) {
+          admission->RestoreBattle(room);
+        }
+        after_login = ladder_config.has_value()
+                          ? ps_client::ShowdownClientStateEnum::kLadder
+                          : ps_client::ShowdownClientStateEnum::kInBattle;
+      }
+    }
+  }
+
   // Add the states to the state machine.
-  state_machine.AddState(ps_client::ShowdownClientStateEnum::kLoggingIn,
-                         std::make_unique<ps_client::LoginState>(ioc));
+  state_machine.AddState(
+      ps_client::ShowdownClientStateEnum::kLoggingIn,
+      std::make_unique<ps_client::LoginState>(ioc, after_login));
   state_machine.AddState(ps_client::ShowdownClientStateEnum::kJoinLobby,
-                         std::make_unique<ps_client::LobbyState>());
+                         std::make_unique<ps_client::LobbyState>(
+                             admission, ladder_config.has_value()));
   state_machine.AddState(ps_client::ShowdownClientStateEnum::kAcceptChallenge,
-                         std::make_unique<ps_client::AcceptChallengeState>());
+                         ps_client::MakeAcceptChallengeState(admission));
   state_machine.AddState(ps_client::ShowdownClientStateEnum::kInBattle,
-                         std::make_unique<ps_client::InBattleState>());
+                         std::make_unique<ps_client::InBattleState>(admission));
+  if (ladder_config.has_value()) {
+    state_machine.AddState(
+        ps_client::ShowdownClientStateEnum::kLadder,
+        std::make_unique<ps_client::LadderState>(ladder_config.value()));
+  }
   state_machine.Start(ps_client::ShowdownClientStateEnum::kLoggingIn);
-  MessageHandler handler(&state_machine, shared_message_queue);
-  handler.Run();
+  ps_client::MessageHandler handler(&state_machine, shared_message_queue,
+                                    snapshot.get());
+  ps_client::PinCurrentThread(thread_layout.handler_cpu);
+  if (thread_layout.single_thread) {
+    handler.RunPolling(ioc);
+  } else {
+    handler.Run();
+  }
+  handler.PrintStats();
 
   // // Keep reading input and sending messages to the WebSocket
   // std::string line;
@@ -196,8 +439,15 @@ int main(int argc, char** argv) {
   //     client.write(line);
   // }
 
-  t.join();
+  if (t.joinable()) {
+    t.join();
+  }
+  fifo_listener.join();
   client.close();
+  std::cout << "[frame filter]" << std::endl;
+  client.frame_filter().PrintStats(std::cout);
+  std::cout << "[outbound] ";
+  client.outbound().PrintStats(std::cout);
 
   return EXIT_SUCCESS;
 }
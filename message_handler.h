@@ -0,0 +1,102 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "inbound_traffic.h"
+#include "latency_histogram.h"
+#include "session_snapshot.h"
+#include "shared_queue.h"
+#include "showdown_state_machine.h"
+
+namespace ps_client {
+
+// Class that takes Message objects from a queue and calls the StateMachine
+// update.
+// TODO: Use smart pointers / move semantics / factory.
+class MessageHandler {
+ public:
+  explicit MessageHandler(
+      ShowdownClientStateMachine* state_machine,
+      std::shared_ptr<util::SharedQueue<std::string>> message_queue,
+      SessionSnapshot* snapshot = nullptr)
+      : state_machine_(state_machine),
+        message_queue_(message_queue),
+        snapshot_(snapshot) {}
+
+  void HandleMessage(const std::string& message) {
+    state_machine_->MutableContext()->SetMessage(message);
+    state_machine_->Update();
+    if (snapshot_ != nullptr) {
+      snapshot_->Save(state_machine_->MutableContext()->session);
+    }
+  }
+
+  // Runs a loop that reads messages from the queue and calls HandleMessage,
+  // until the queue is closed.
+  void Run() {
+    while (true) {
+      Clock::time_point enqueued_at;
+      std::optional<std::string> message =
+          message_queue_->Dequeue(&enqueued_at);
+      if (!message.has_value()) {
+        break;
+      }
+      Process(message.value(), enqueued_at);
+    }
+  }
+
+  // Runs `ioc` and handles queued messages on the calling thread, spinning
+  // between the two, until `ioc` is stopped.
+  void RunPolling(boost::asio::io_context& ioc) {
+    while (!ioc.stopped()) {
+      size_t work = ioc.poll();
+      Clock::time_point enqueued_at;
+      while (std::optional<std::string> message =
+                 message_queue_->TryDequeue(&enqueued_at)) {
+        Process(message.value(), enqueued_at);
+        ++work;
+      }
+      if (work == 0) {
+        util::CpuRelax();
+      }
+    }
+  }
+
+  void PrintStats() const {
+    std::cout << "[queue] ";
+    PrintInboundStats(std::cout, message_queue_->Stats());
+    std::cout << "[latency] queue ";
+    queue_latency_.Print(std::cout);
+    std::cout << std::endl;
+  }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  // Number of handled messages between queue metric reports.
+  static constexpr size_t kStatsInterval = 1000;
+
+  void Process(const std::string& message, Clock::time_point enqueued_at) {
+    queue_latency_.Record(Clock::now() - enqueued_at);
+    std::cout << "Received message: " << message << std::endl;
+    state_machine_->MutableContext()->received_at = enqueued_at;
+    HandleMessage(message);
+    if (++handled_ % kStatsInterval == 0) {
+      PrintStats();
+    }
+  }
+
+  ShowdownClientStateMachine* state_machine_;
+  std::shared_ptr<util::SharedQueue<std::string>> message_queue_;
+  SessionSnapshot* snapshot_;
+  size_t handled_ = 0;
+  // Time messages wait in the queue before being handled.
+  LatencyHistogram queue_latency_;
+};
+
+}  // namespace ps_client
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "latency_histogram.h"
+
+namespace ps_client {
+
+// Priority classes of messages sent to the server, most urgent first.
+enum class OutboundClass {
+  // Battle choices, and the login they all depend on.
+  kChoice,
+  // Accepting and rejecting challenges, team uploads and ladder searches.
+  kMatchmaking,
+  // Chat, joins and everything else.
+  kOther,
+  kCount,
+};
+
+inline constexpr size_t kOutboundClassCount =
+    static_cast<size_t>(OutboundClass::kCount);
+
+inline std::string_view OutboundClassName(OutboundClass outbound_class) {
+  switch (outbound_class) {
+    case OutboundClass::kChoice:
+      return "choice";
+    case OutboundClass::kMatchmaking:
+      return "matchmaking";
+    default:
+      return "other";
+  }
+}
+
+// Classifies a message by its command, e.g. "/choose move 1".
+inline OutboundClass ClassifyCommand(std::string_view message) {
+  std::string_view command = message.substr(0, message.find(' '));
+  if (command == "/choose" || command == "/team" || command == "/undo" ||
+      command == "/trn") {
+    return OutboundClass::kChoice;
+  }
+  if (command == "/accept" || command == "/reject" || command == "/utm" ||
+      command == "/search" || command == "/cancelsearch") {
+    return OutboundClass::kMatchmaking;
+  }
+  return OutboundClass::kOther;
+}
+
+struct OutboundConfig {
+  using Clock = std::chrono::steady_clock;
+
+  // Messages that can be sent back to back. The server buffers up to 6
+  // messages per connection and drops the rest.
+  size_t burst = 6;
+  // Time per message once the burst is used up. The server handles one
+  // message per 600ms from users that are not trusted.
+  Clock::duration interval = std::chrono::milliseconds(600);
+  // How long a message of each class may wait before it is sent ahead of
+  // more urgent classes.
+  std::array<Clock::duration, kOutboundClassCount> max_delay = {
+      std::chrono::seconds(0), std::chrono::seconds(5),
+      std::chrono::seconds(30)};
+};
+
+// Orders outgoing messages and paces them below the server's throttle with
+// a token bucket (kept as a theoretical arrival time). Messages go out by
+// class, except that messages past their deadline (queued time plus the
+// class max_delay) go ahead of classes still within theirs, earliest
+// deadline first. Choices have no slack, so they are always overdue, and a
+// message of another class gets ahead of them once its deadline is earlier.
+// Within a class the deadlines follow the queue order. Not thread safe.
+class OutboundScheduler {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit OutboundScheduler(const OutboundConfig& config = {})
+      : config_(config) {}
+
+  // Queues `frame`. A battle choice passes when the request it answers was
+  // received, and its frame-to-command latency is recorded once it is sent.
+  void Push(std::string frame, OutboundClass outbound_class,
+            Clock::time_point now,
+            std::optional<Clock::time_point> requested_at = std::nullopt) {
+    size_t index = static_cast<size_t>(outbound_class);
+    queues_[index].push_back(Pending{std::move(frame), now,
+                                     now + config_.max_delay[index], false,
+                                     requested_at});
+    peak_depth_ = std::max(peak_depth_, Depth());
+  }
+
+  // Takes the next frame to send if the bucket allows it. Otherwise returns
+  // nullopt and, if frames are waiting, sets `retry_at` to when the next one
+  // can go.
+  std::optional<std::string> Pop(Clock::time_point now,
+                                 Clock::time_point* retry_at) {
+    std::deque<Pending>* queue = Next(now);
+    if (queue == nullptr) {
+      return std::nullopt;
+    }
+    // Allowed while the theoretical arrival time is within the burst.
+    Clock::duration tolerance = config_.interval * (config_.burst - 1);
+    if (now < next_send_at_ - tolerance) {
+      *retry_at = next_send_at_ - tolerance;
+      for (auto& class_queue : queues_) {
+        for (Pending& pending : class_queue) {
+          pending.throttled = true;
+        }
+      }
+      return std::nullopt;
+    }
+    next_send_at_ = std::max(next_send_at_, now) + config_.interval;
+
+    size_t index = queue - queues_.data();
+    Pending pending = std::move(queue->front());
+    queue->pop_front();
+    ++sent_[index];
+    throttled_[index] += pending.throttled;
+    queue_delay_[index].Record(now - pending.queued_at);
+    if (pending.requested_at.has_value()) {
+      frame_to_command_.Record(now - *pending.requested_at);
+    }
+    return std::move(pending.frame);
+  }
+
+  bool Empty() const { return Depth() == 0; }
+
+  size_t Depth() const {
+    size_t depth = 0;
+    for (const auto& queue : queues_) {
+      depth += queue.size();
+    }
+    return depth;
+  }
+
+  // From battle requests being received to their choices being sent.
+  const LatencyHistogram& FrameToCommand() const { return frame_to_command_; }
+
+  // Prints sends, sends held back by the bucket, and queue delays per class,
+  // then the frame-to-command latency.
+  void PrintStats(std::ostream& os) const {
+    os << "depth=" << Depth() << " peak_depth=" << peak_depth_ << std::endl;
+    for (size_t i = 0; i < kOutboundClassCount; ++i) {
+      os << "  " << OutboundClassName(static_cast<OutboundClass>(i))
+         << ": sent=" << sent_[i] << " throttled=" << throttled_[i]
+         << " delay ";
+      queue_delay_[i].Print(os);
+      os << std::endl;
+    }
+    os << "  frame_to_command ";
+    frame_to_command_.Print(os);
+    os << std::endl;
+  }
+
+ private:
+  struct Pending {
+    std::string frame;
+    Clock::time_point queued_at;
+    Clock::time_point deadline;
+    // Waited for the bucket at least once.
+    bool throttled;
+    // When the request a choice answers was received.
+    std::optional<Clock::time_point> requested_at;
+  };
+
+  // The class whose overdue front has the earliest deadline, the most
+  // urgent one on a tie, else the most urgent non-empty class.
+  std::deque<Pending>* Next(Clock::time_point now) {
+    std::deque<Pending>* first = nullptr;
+    std::deque<Pending>* overdue = nullptr;
+    for (auto& queue : queues_) {
+      if (queue.empty()) {
+        continue;
+      }
+      if (queue.front().deadline <= now &&
+          (overdue == nullptr ||
+           queue.front().deadline < overdue->front().deadline)) {
+        overdue = &queue;
+      }
+      if (first == nullptr) {
+        first = &queue;
+      }
+    }
+    return overdue != nullptr ? overdue : first;
+  }
+
+  OutboundConfig config_;
+  std::array<std::deque<Pending>, kOutboundClassCount> queues_;
+  Clock::time_point next_send_at_{};
+  size_t peak_depth_ = 0;
+  std::array<uint64_t, kOutboundClassCount> sent_{};
+  std::array<uint64_t, kOutboundClassCount> throttled_{};
+  std::array<LatencyHistogram, kOutboundClassCount> queue_delay_;
+  LatencyHistogram frame_to_command_;
+};
+
+}  // namespace ps_client
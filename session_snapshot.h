@@ -0,0 +1,226 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "showdown_state_machine.h"
+
+namespace ps_client {
+
+// A session read back from a snapshot.
+struct SavedSession {
+  std::string team;
+  std::vector<std::string> battle_rooms;
+};
+
+// Keeps the session progress in a memory-mapped file, so a client restarted
+// after a crash can log back in and rejoin its battles.
+// Saving only stores to the shared mapping and never makes a system call;
+// the kernel writes the pages back, so a killed process loses nothing it
+// saved. Two slots are written alternately and each carries a checksum, so
+// a torn write leaves the previous save readable. The file is locked while
+// it is mapped, so two clients cannot share one snapshot. Only used from the
+// message handling thread.
+class SessionSnapshot {
+ public:
+  // Packed teams of six are well under 2KB, but some formats allow more
+  // Pokémon.
+  static constexpr size_t kMaxTeamSize = 8192;
+  static constexpr size_t kMaxRooms = 16;
+  // Room ids of passworded or hidden battles carry a 32 character password
+  // after the format and battle number.
+  static constexpr size_t kMaxRoomSize = 160;
+
+  // Maps the snapshot at `path`, creating it if needed. The path must not be
+  // a symlink, and must be a regular file owned by this user that no other
+  // client has open. Returns nullptr on error.
+  static std::unique_ptr<SessionSnapshot> Open(const std::string& path) {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC,
+                  0600);
+    if (fd < 0) {
+      std::cerr << "Failed to open snapshot " << path << ": "
+                << std::strerror(errno) << std::endl;
+      return nullptr;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) ||
+        info.st_uid != geteuid() || (info.st_mode & 0077) != 0) {
+      std::cerr << "Refusing snapshot " << path
+                << ": not a private regular file of this user" << std::endl;
+      close(fd);
+      return nullptr;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+      std::cerr << "Failed to lock snapshot " << path << ": "
+                << std::strerror(errno) << std::endl;
+      close(fd);
+      return nullptr;
+    }
+    if (ftruncate(fd, sizeof(File)) != 0) {
+      std::cerr << "Failed to size snapshot " << path << ": "
+                << std::strerror(errno) << std::endl;
+      close(fd);
+      return nullptr;
+    }
+    void* mapping =
+        mmap(nullptr, sizeof(File), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+      std::cerr << "Failed to map snapshot " << path << ": "
+                << std::strerror(errno) << std::endl;
+      close(fd);
+      return nullptr;
+    }
+    return std::unique_ptr<SessionSnapshot>(
+        new SessionSnapshot(fd, static_cast<File*>(mapping)));
+  }
+
+  SessionSnapshot(const SessionSnapshot&) = delete;
+  SessionSnapshot& operator=(const SessionSnapshot&) = delete;
+  ~SessionSnapshot() {
+    munmap(file_, sizeof(File));
+    // Also drops the lock.
+    close(fd_);
+  }
+
+  // Returns the last complete save, if any.
+  std::optional<SavedSession> Load() const {
+    const Record* record = Latest();
+    if (record == nullptr) {
+      return std::nullopt;
+    }
+    SavedSession session{std::string(record->team, record->team_size), {}};
+    for (uint32_t i = 0; i < record->num_rooms; ++i) {
+      session.battle_rooms.emplace_back(record->rooms[i],
+                                        record->room_sizes[i]);
+    }
+    return session;
+  }
+
+  // Saves the progress if it changed since the last save. A team or room
+  // that does not fit is left out, and reported since a resume will miss it.
+  void Save(const SessionProgress& progress) {
+    if (saved_ && progress.version == saved_version_) {
+      return;
+    }
+    Record record{};
+    record.sequence = next_sequence_;
+    if (progress.team.size() <= kMaxTeamSize) {
+      record.team_size = static_cast<uint32_t>(progress.team.size());
+      std::memcpy(record.team, progress.team.data(), progress.team.size());
+    } else {
+      std::cerr << "[snapshot] team of " << progress.team.size()
+                << " bytes is over " << kMaxTeamSize
+                << " and will not be restored" << std::endl;
+    }
+    for (const std::string& room : progress.battle_rooms) {
+      if (record.num_rooms == kMaxRooms || room.size() > kMaxRoomSize) {
+        std::cerr << "[snapshot] " << room
+                  << " does not fit and will not be rejoined" << std::endl;
+        continue;
+      }
+      record.room_sizes[record.num_rooms] = static_cast<uint8_t>(room.size());
+      std::memcpy(record.rooms[record.num_rooms], room.data(), room.size());
+      ++record.num_rooms;
+    }
+    record.checksum = Checksum(record);
+    std::memcpy(&file_->slots[next_sequence_ % 2], &record, sizeof(Record));
+
+    ++next_sequence_;
+    saved_ = true;
+    saved_version_ = progress.version;
+  }
+
+ private:
+  static constexpr uint64_t kMagic = 0x70735f736e617031;  // "ps_snap1"
+  static constexpr uint32_t kVersion = 2;
+
+  struct Record {
+    // 0 for a slot that was never written.
+    uint64_t sequence;
+    uint32_t team_size;
+    uint32_t num_rooms;
+    uint8_t room_sizes[kMaxRooms];
+    char team[kMaxTeamSize];
+    char rooms[kMaxRooms][kMaxRoomSize];
+    // Over every byte before it.
+    uint64_t checksum;
+  };
+  static_assert(kMaxRoomSize <= std::numeric_limits<uint8_t>::max());
+
+  struct File {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    Record slots[2];
+  };
+
+  SessionSnapshot(int fd, File* file) : fd_(fd), file_(file) {
+    if (file_->magic != kMagic || file_->version != kVersion ||
+        file_->record_size != sizeof(Record)) {
+      std::memset(file_, 0, sizeof(File));
+      file_->magic = kMagic;
+      file_->version = kVersion;
+      file_->record_size = sizeof(Record);
+    }
+    const Record* latest = Latest();
+    next_sequence_ = latest != nullptr ? latest->sequence + 1 : 1;
+  }
+
+  // 64-bit FNV-1a.
+  static uint64_t Checksum(const Record& record) {
+    const auto* bytes = reinterpret_cast<const unsigned char*>(&record);
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < offsetof(Record, checksum); ++i) {
+      hash ^= bytes[i];
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+
+  static bool Valid(const Record& record) {
+    if (record.sequence == 0 || record.checksum != Checksum(record) ||
+        record.team_size > kMaxTeamSize || record.num_rooms > kMaxRooms) {
+      return false;
+    }
+    for (uint32_t i = 0; i < record.num_rooms; ++i) {
+      if (record.room_sizes[i] > kMaxRoomSize) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // The valid slot with the highest sequence, or nullptr.
+  const Record* Latest() const {
+    const Record* latest = nullptr;
+    for (const Record& record : file_->slots) {
+      if (Valid(record) &&
+          (latest == nullptr || record.sequence > latest->sequence)) {
+        latest = &record;
+      }
+    }
+    return latest;
+  }
+
+  // Kept open to hold the lock.
+  int fd_;
+  File* file_;
+  uint64_t next_sequence_ = 1;
+  bool saved_ = false;
+  uint64_t saved_version_ = 0;
+};
+
+}  // namespace ps_client
@@ -1,61 +1,239 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <mutex>
 #include <optional>
-#include <queue>
 
 namespace util {
 
+// Up to this many traffic classes can be tracked by a SharedQueue.
+inline constexpr size_t kMaxTrafficClasses = 8;
+
+// Hint to the CPU that the calling thread is spinning.
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+// Capacity and load shedding policy for a SharedQueue.
+struct SharedQueueOptions {
+  // Maximum number of queued items. 0 means unbounded.
+  size_t capacity = 0;
+  // Shed priority for each traffic class. 0 means the class is never shed;
+  // when the queue is full, classes with a higher value are shed first.
+  std::array<uint8_t, kMaxTrafficClasses> shed_priority{};
+  // Times Dequeue checks for an item before parking on the condition
+  // variable. Spinning trades a busy core for a faster handoff.
+  uint32_t spin_iterations = 0;
+};
+
+// Snapshot of the queue metrics.
+struct SharedQueueStats {
+  size_t depth = 0;
+  size_t peak_depth = 0;
+  size_t bytes = 0;
+  size_t peak_bytes = 0;
+  std::array<uint64_t, kMaxTrafficClasses> enqueued{};
+  std::array<uint64_t, kMaxTrafficClasses> dropped{};
+};
+
 template <typename T>
 class SharedQueue {
  public:
+  using Clock = std::chrono::steady_clock;
+
   SharedQueue() = default;
+  explicit SharedQueue(const SharedQueueOptions& options) : options_(options) {}
   ~SharedQueue() = default;
 
-  // Add an element to the queue
-  void Enqueue(const T& item) {
+  // Add an element to the queue. When the queue is at capacity, the queued
+  // item of the most sheddable class is evicted to make room, or the new item
+  // is dropped if nothing queued is more sheddable than it. Items of a class
+  // with shed priority 0 are never dropped, even past capacity.
+  // Returns false if the item was dropped, or if `traffic_class` is not below
+  // kMaxTrafficClasses.
+  bool Enqueue(const T& item, size_t traffic_class = 0) {
+    if (traffic_class >= kMaxTrafficClasses) {
+      return false;
+    }
+    Clock::time_point now = Clock::now();
+    bool wake = false;
     {
       std::lock_guard<std::mutex> lock(mutex_);
-      queue_.push(item);
+      stats_.enqueued[traffic_class]++;
+      if (options_.capacity != 0 && count_ >= options_.capacity &&
+          !MakeRoom(traffic_class)) {
+        stats_.dropped[traffic_class]++;
+        return false;
+      }
+      queues_[traffic_class].push_back(Entry{item, next_sequence_++, now});
+      ++count_;
+      stats_.bytes += ItemBytes(item);
+      stats_.peak_bytes = std::max(stats_.peak_bytes, stats_.bytes);
+      stats_.peak_depth = std::max(stats_.peak_depth, count_);
+      size_.store(count_, std::memory_order_release);
+      wake = waiters_ > 0;
     }
-    cond_var_.notify_one();
+    // A spinning consumer picks the item up without a wakeup.
+    if (wake) {
+      cond_var_.notify_one();
+    }
+    return true;
   }
 
   // Get the front element from the queue, blocks if the queue is empty.
-  std::optional<T> Dequeue() {
+  // Spins for `spin_iterations` before blocking. If `enqueued_at` is given,
+  // it receives the time the element was enqueued.
+  std::optional<T> Dequeue(Clock::time_point* enqueued_at = nullptr) {
+    for (uint32_t i = 0; i < options_.spin_iterations &&
+                         size_.load(std::memory_order_acquire) == 0;
+         ++i) {
+      CpuRelax();
+    }
     std::unique_lock<std::mutex> lock(mutex_);
-    cond_var_.wait(lock, [this] { return closed_ || !queue_.empty(); });
+    ++waiters_;
+    cond_var_.wait(lock, [this] { return closed_ || count_ > 0; });
+    --waiters_;
     if (closed_) {
       return std::nullopt;
     }
-    T item = queue_.front();
-    queue_.pop();
-    return item;
+    return PopFront(enqueued_at);
+  }
+
+  // Get the front element from the queue if there is one, without blocking.
+  std::optional<T> TryDequeue(Clock::time_point* enqueued_at = nullptr) {
+    if (size_.load(std::memory_order_acquire) == 0) {
+      return std::nullopt;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_ || count_ == 0) {
+      return std::nullopt;
+    }
+    return PopFront(enqueued_at);
   }
 
   // Check if the queue is empty
   bool Empty() const {
     std::lock_guard<std::mutex> lock(mutex_);
-    return queue_.empty();
+    return count_ == 0;
   }
 
   // Get the size of the queue
   size_t Size() const {
     std::lock_guard<std::mutex> lock(mutex_);
-    return queue_.size();
+    return count_;
+  }
+
+  // Get a snapshot of the queue metrics.
+  SharedQueueStats Stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    SharedQueueStats stats = stats_;
+    stats.depth = count_;
+    return stats;
+  }
+
+  bool Closed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return closed_;
   }
 
   void Close() {
-    closed_ = true;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
     cond_var_.notify_all();
   }
 
  private:
+  struct Entry {
+    T item;
+    // Enqueue order across all classes.
+    uint64_t sequence;
+    Clock::time_point enqueued_at;
+  };
+
+  // Pops the oldest item across the class queues. Must hold mutex_ and the
+  // queue must not be empty.
+  T PopFront(Clock::time_point* enqueued_at) {
+    std::deque<Entry>* oldest = nullptr;
+    for (std::deque<Entry>& queue : queues_) {
+      if (!queue.empty() &&
+          (oldest == nullptr ||
+           queue.front().sequence < oldest->front().sequence)) {
+        oldest = &queue;
+      }
+    }
+    Entry entry = std::move(oldest->front());
+    oldest->pop_front();
+    size_.store(--count_, std::memory_order_release);
+    stats_.bytes -= ItemBytes(entry.item);
+    if (enqueued_at != nullptr) {
+      *enqueued_at = entry.enqueued_at;
+    }
+    return std::move(entry.item);
+  }
+
+  // Approximate memory held by an item.
+  static size_t ItemBytes(const T& item) {
+    if constexpr (requires { item.capacity(); }) {
+      return sizeof(Entry) + item.capacity();
+    } else {
+      return sizeof(Entry);
+    }
+  }
+
+  // Evicts the oldest queued item of the most sheddable class, as long as it
+  // is more sheddable than `incoming_class`. If nothing can be evicted, an
+  // unsheddable item is still let through. Must hold mutex_.
+  bool MakeRoom(size_t incoming_class) {
+    uint8_t incoming_priority = options_.shed_priority[incoming_class];
+    size_t victim_class = kMaxTrafficClasses;
+    uint8_t victim_priority = incoming_priority;
+    for (size_t i = 0; i < kMaxTrafficClasses; ++i) {
+      if (!queues_[i].empty() &&
+          options_.shed_priority[i] > victim_priority) {
+        victim_class = i;
+        victim_priority = options_.shed_priority[i];
+      }
+    }
+    if (victim_class == kMaxTrafficClasses) {
+      return incoming_priority == 0;
+    }
+
+    std::deque<Entry>& victims = queues_[victim_class];
+    stats_.bytes -= ItemBytes(victims.front().item);
+    stats_.dropped[victim_class]++;
+    victims.pop_front();
+    size_.store(--count_, std::memory_order_release);
+    return true;
+  }
+
   mutable std::mutex mutex_;
-  std::queue<T> queue_;
+  // One FIFO per traffic class, so the oldest item of a class is evicted
+  // without searching. Dequeue takes the lowest sequence across the fronts.
+  std::array<std::deque<Entry>, kMaxTrafficClasses> queues_;
+  // Items across all of queues_.
+  size_t count_ = 0;
+  uint64_t next_sequence_ = 0;
   std::condition_variable cond_var_;
   bool closed_ = false;
+  // Consumers blocked on cond_var_.
+  size_t waiters_ = 0;
+  // Mirrors count_ so spinning consumers need not take the lock.
+  std::atomic<size_t> size_{0};
+  SharedQueueOptions options_;
+  SharedQueueStats stats_;
 };
 
 }  // namespace util
@@ -1,18 +1,31 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
 #include <functional>
 #include <iostream>
-#include <nlohmann/json.hpp>
+#include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
 #include <variant>
+#include <vector>
 
+#include "coro_state_machine.h"
+#include "decision_plugin.h"
+#include "latency_histogram.h"
 #include "state_machine.h"
+#include "team_codec.h"
 #include "util.h"
 
 namespace ps_client {
 
+// Room ids such as "lobby" or "battle-gen9ou-123" never contain spaces or
+// line breaks.
+inline bool IsRoomId(std::string_view room) {
+  return !room.empty() && room.find_first_of(" \t\r\n|") == std::string::npos;
+}
+
 // Struct for decomposing a message into header and contents.
 struct WebsocketMessage {
   std::string_view header;
@@ -41,11 +54,15 @@ struct WebsocketMessage {
 // For a battle message containing multiple WebsocketMessage.
 struct CompoundWebsocketMessage {
   std::vector<WebsocketMessage> messages;
+  // Room id from the first line, without the leading ">".
+  std::string_view room;
 
-  // Determined by a line containing ">" at the beginning.
+  // Determined by a line containing ">" and a room id at the beginning,
+  // followed by at least one "|" line. A bot command such as
+  // ">battle-gen9ou-1 move 1" is not a frame.
   static std::optional<CompoundWebsocketMessage> CreateCompoundMessage(
       std::string_view compount_message) {
-    if (compount_message[0] != '>') {
+    if (!compount_message.starts_with('>')) {
       return std::nullopt;
     }
     // Find the first newline character.
@@ -53,6 +70,10 @@ struct CompoundWebsocketMessage {
     if (first_newline == std::string::npos) {
       return std::nullopt;
     }
+    std::string_view room = compount_message.substr(1, first_newline - 1);
+    if (!IsRoomId(room)) {
+      return std::nullopt;
+    }
     // Get the compount_message after the first newline.
     std::string_view body = compount_message.substr(first_newline + 1);
 
@@ -67,35 +88,71 @@ struct CompoundWebsocketMessage {
         messages.push_back(message_or.value());
       }
     }
+    if (messages.empty()) {
+      return std::nullopt;
+    }
 
-    return CompoundWebsocketMessage{messages};
+    return CompoundWebsocketMessage{messages, room};
+  }
+
+  // True for the first frame of a battle the client plays in: it has the
+  // "|init|battle" line, or a "|request|" when rejoining. Frames that still
+  // arrive for a battle after its end, such as "|l|" or "|deinit|", have
+  // neither.
+  bool StartsBattle() const {
+    return std::any_of(
+        messages.begin(), messages.end(), [](const WebsocketMessage& message) {
+          return (message.header == "init" && message.contents == "battle") ||
+                 message.header == "request";
+        });
   }
 };
 
-// For parsing the team JSON string.
+// For parsing the team JSON string. The team is converted to packed format.
 struct Team {
   std::string team_as_str;
 
   static std::optional<Team> CreateTeam(std::string_view team) {
-    // If the team is not a valid JSON string, return nullopt.
-    Team result;
-    try {
-      nlohmann::json team_as_json = nlohmann::json::parse(team);
-      result.team_as_str = team_as_json["team"];
-    } catch (const nlohmann::json::parse_error& e) {
+    // Only JSON objects can be teams; skip the cache for anything else.
+    auto first = team.find_first_not_of(" \t\r\n");
+    if (first == std::string_view::npos || team[first] != '{') {
+      return std::nullopt;
+    }
+    std::optional<std::string> packed = Cache().GetOrPack(team);
+    if (!packed.has_value()) {
       return std::nullopt;
     }
+    return Team{std::move(packed.value())};
+  }
 
-    return result;
+  // Teams are only created from the message handling thread.
+  static TeamCache& Cache() {
+    static TeamCache cache;
+    return cache;
   }
 };
 
-// Data for representing a command from the bot.
+// Data for representing a command from the bot, e.g. "move 1", optionally
+// addressed to a battle as ">battle-gen9ou-123 move 1".
 struct BotCommand {
   std::string command;
   std::string argument;
+  // Empty if the command was not addressed.
+  std::string room;
 
   static std::optional<BotCommand> CreateCommand(std::string_view message) {
+    std::string_view room;
+    if (message.starts_with('>')) {
+      auto room_end = message.find(' ');
+      if (room_end == std::string::npos) {
+        return std::nullopt;
+      }
+      room = message.substr(1, room_end - 1);
+      if (!IsRoomId(room)) {
+        return std::nullopt;
+      }
+      message = message.substr(room_end + 1);
+    }
     auto first_space = message.find(' ');
     if (first_space == std::string::npos) {
       return std::nullopt;
@@ -107,7 +164,8 @@ struct BotCommand {
     }
 
     return BotCommand{std::string(message.substr(0, first_space)),
-                      std::string(message.substr(first_space + 1))};
+                      std::string(message.substr(first_space + 1)),
+                      std::string(room)};
   }
 };
 
@@ -120,14 +178,78 @@ enum class ShowdownClientStateEnum {
   kJoinLobby,
   kAcceptChallenge,
   kInBattle,
+  kLadder,
   kDisconnecting,
 };
 
+class BattleTracker;
+class DeadlineTimers;
+
+// Progress of the session that a restarted client needs to pick up where it
+// left off. Saved by SessionSnapshot.
+struct SessionProgress {
+  using Clock = std::chrono::steady_clock;
+
+  // Packed team last uploaded with /utm, empty before the first upload.
+  std::string team;
+  // Battles waiting for decisions from the client.
+  std::vector<std::string> battle_rooms;
+  // Bumped on every change, so unchanged progress is not saved again.
+  uint64_t version = 0;
+  // Start of the process when the session was restored, until the first
+  // decision after the restart.
+  std::optional<Clock::time_point> resumed_at;
+
+  void SetTeam(std::string packed_team) {
+    if (packed_team != team) {
+      team = std::move(packed_team);
+      ++version;
+    }
+  }
+
+  void AddBattleRoom(std::string_view room) {
+    if (std::find(battle_rooms.begin(), battle_rooms.end(), room) ==
+        battle_rooms.end()) {
+      battle_rooms.emplace_back(room);
+      ++version;
+    }
+  }
+
+  void RemoveBattleRoom(std::string_view room) {
+    if (std::erase(battle_rooms, room) > 0) {
+      ++version;
+    }
+  }
+
+  // Reports the time from the restart to the first decision sent after it.
+  void OnDecisionSent() {
+    if (!resumed_at.has_value()) {
+      return;
+    }
+    std::cout << "[resume] first decision "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(
+                     Clock::now() - resumed_at.value())
+                     .count()
+              << "ms after restart" << std::endl;
+    resumed_at.reset();
+  }
+};
+
 struct WebsocketState {
   using WriteCallback = std::function<void(const std::string&)>;
+  using RoomWriteCallback =
+      std::function<void(std::string_view room, const std::string&)>;
+  // Like RoomWriteCallback, for a battle choice answering a request received
+  // at `requested_at`, if known.
+  using ChoiceWriteCallback = std::function<void(
+      std::string_view room, const std::string&,
+      std::optional<std::chrono::steady_clock::time_point> requested_at)>;
   WebsocketState(const WriteCallback& socket_callback,
-                 const WriteCallback& fifo_callback)
-      : socket_write{socket_callback}, fifo_write{fifo_callback} {}
+                 const WriteCallback& fifo_callback,
+                 const RoomWriteCallback& room_callback = {})
+      : socket_write{socket_callback},
+        fifo_write{fifo_callback},
+        room_write{room_callback} {}
   WebsocketState(const WebsocketState&) = default;
   WebsocketState(WebsocketState&&) = default;
   WebsocketState& operator=(const WebsocketState&) = default;
@@ -172,9 +294,68 @@ struct WebsocketState {
 
   // Callback for writing messages to the FIFO.
   WriteCallback fifo_write;
+
+  // Battle lines go to the FIFO as ">ROOM\n|HEADER|CONTENTS" instead of
+  // "|HEADER|CONTENTS", for bots that play several battles at once.
+  bool fifo_room_tags = false;
+
+  // Callback for writing messages to a room on the server.
+  RoomWriteCallback room_write;
+
+  // Callback for writing battle choices, so their latency is measured up to
+  // the socket. room_write is used if not set.
+  ChoiceWriteCallback choice_write;
+
+  // Makes battle decisions in process when set. Otherwise battle lines are
+  // forwarded to the bot through fifo_write.
+  std::shared_ptr<DecisionPlugin> decision_plugin;
+
+  // Deadlines that come back as "|deadline|ROOM|KIND|ID" messages, if set.
+  std::shared_ptr<DeadlineTimers> timers;
+
+  // Names revealed in each battle, as dex ids, if set.
+  std::shared_ptr<BattleTracker> battle_tracker;
+
+  // Team and battles to restore after a restart.
+  SessionProgress session;
+
+  // When the reader queued last_message.
+  std::chrono::steady_clock::time_point received_at;
+
+  // Time from battle requests to the choices sent for them.
+  DecisionLatency decision_latency;
 };
 
 using ShowdownClientStateMachine =
     state_machine::StateMachine<ShowdownClientStateEnum, WebsocketState>;
 
+// Coroutine flavor of the client state machine, for writing a state as a
+// straight-line coroutine that co_awaits the messages it needs.
+using ShowdownClientCoroMachine =
+    state_machine::CoroStateMachine<ShowdownClientStateEnum, WebsocketState>;
+
+// Matches a WebsocketMessage, or a frame containing a line, with one of
+// `headers`, e.g. MatchHeader({"pm", "init"}).
+inline ShowdownClientCoroMachine::Matcher MatchHeader(
+    std::vector<std::string> headers) {
+  return [headers = std::move(headers)](const WebsocketState& state) {
+    auto listed = [&headers](std::string_view header) {
+      return std::find(headers.begin(), headers.end(), header) !=
+             headers.end();
+    };
+    if (const auto* message =
+            std::get_if<WebsocketMessage>(&state.last_message)) {
+      return listed(message->header);
+    }
+    if (const auto* compound =
+            std::get_if<CompoundWebsocketMessage>(&state.last_message)) {
+      return std::any_of(compound->messages.begin(), compound->messages.end(),
+                         [&listed](const WebsocketMessage& message) {
+                           return listed(message.header);
+                         });
+    }
+    return false;
+  };
+}
+
 }  // namespace ps_client
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+#include "frame_pool.h"
+#include "state_machine.h"
+
+namespace state_machine {
+
+// Coroutine flavor of StateMachine. Each state is a coroutine that runs
+// straight through, co_awaits the messages it needs with Next(), and
+// co_returns the state to go to. The machine only keeps the suspended frame
+// of the current state, allocated from FramePool, so an idle flow costs the
+// machine plus one frame.
+//
+//   Task Lobby(Machine& machine, Context* context) {
+//     bool matched = co_await machine.Next(IsChallenge, kTimeout);
+//     if (!matched) {
+//       co_return State::kLobby;  // Timed out.
+//     }
+//     co_return State::kAccept;
+//   }
+//
+// A state that returns a state the machine does not hold ends the flow
+// there, so a machine can hold a few states of a larger StateMachine and
+// hand back to it.
+//
+// Frames are pooled per thread: a machine must be driven and destroyed on the
+// thread that created it.
+template <EnumType StateEnum, typename Context>
+class CoroStateMachine {
+ public:
+  // Expose template arguments.
+  using StateEnumType = StateEnum;
+  using ContextType = Context;
+  using Clock = std::chrono::steady_clock;
+  // Returns true for messages the state is waiting for.
+  using Matcher = std::function<bool(const Context&)>;
+
+  // Coroutine type of a state, producing the next state.
+  class Task {
+   public:
+    struct promise_type {
+      StateEnum next_state{};
+
+      Task get_return_object() {
+        return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+      }
+      std::suspend_always initial_suspend() noexcept { return {}; }
+      std::suspend_always final_suspend() noexcept { return {}; }
+      void return_value(StateEnum state) { next_state = state; }
+      void unhandled_exception() { std::terminate(); }
+
+      static void* operator new(size_t size) {
+        return FramePool::Allocate(size);
+      }
+      static void operator delete(void* frame, size_t size) {
+        FramePool::Deallocate(frame, size);
+      }
+    };
+
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    Task& operator=(Task&& other) noexcept {
+      if (this != &other) {
+        Reset();
+        handle_ = std::exchange(other.handle_, {});
+      }
+      return *this;
+    }
+    ~Task() { Reset(); }
+
+   private:
+    friend class CoroStateMachine;
+
+    explicit Task(std::coroutine_handle<promise_type> handle)
+        : handle_(handle) {}
+
+    void Reset() {
+      if (handle_) {
+        handle_.destroy();
+        handle_ = {};
+      }
+    }
+
+    std::coroutine_handle<promise_type> handle_;
+  };
+
+  using StateFn = std::function<Task(CoroStateMachine&, Context*)>;
+  using States = std::unordered_map<StateEnum, StateFn>;
+
+  // Awaitable returned by Next(). Resumes with true when a matching message
+  // arrives, or false when the timeout passes first.
+  class Awaiter {
+   public:
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<>) noexcept {
+      machine_->matcher_ = std::move(matcher_);
+      machine_->deadline_ = deadline_;
+      machine_->timed_out_ = false;
+    }
+    bool await_resume() noexcept {
+      machine_->matcher_ = nullptr;
+      machine_->deadline_.reset();
+      return !machine_->timed_out_;
+    }
+
+   private:
+    friend class CoroStateMachine;
+
+    Awaiter(CoroStateMachine* machine, Matcher matcher,
+            std::optional<Clock::time_point> deadline)
+        : machine_(machine), matcher_(std::move(matcher)), deadline_(deadline) {}
+
+    CoroStateMachine* machine_;
+    Matcher matcher_;
+    std::optional<Clock::time_point> deadline_;
+  };
+
+  explicit CoroStateMachine(Context* context)
+      : context_(context), states_(std::make_shared<States>()) {}
+
+  // Creates a machine for another flow that shares the states of `prototype`.
+  CoroStateMachine(Context* context, const CoroStateMachine& prototype)
+      : context_(context), states_(prototype.states_) {}
+
+  void AddState(StateEnum state_enum, StateFn state) {
+    (*states_)[state_enum] = std::move(state);
+  }
+
+  void Start(StateEnum start_enum) { Enter(start_enum); }
+
+  // Waits for the next message accepted by `matcher`.
+  Awaiter Next(Matcher matcher) {
+    return Awaiter(this, std::move(matcher), std::nullopt);
+  }
+
+  // Waits for the next message accepted by `matcher`, for at most `timeout`.
+  Awaiter Next(Matcher matcher, Clock::duration timeout) {
+    return Awaiter(this, std::move(matcher), Clock::now() + timeout);
+  }
+
+  // Offers the message in the context to the current state.
+  void Update() {
+    if (task_ && matcher_ && matcher_(*context_)) {
+      Resume();
+    }
+  }
+
+  // Resumes the current state if its timeout has passed.
+  void Tick(Clock::time_point now) {
+    if (task_ && deadline_.has_value() && *deadline_ <= now) {
+      timed_out_ = true;
+      Resume();
+    }
+  }
+
+  // When the current state stops waiting, if it has a timeout.
+  std::optional<Clock::time_point> Deadline() const { return deadline_; }
+
+  // False once the flow ended in a state the machine does not hold.
+  bool Running() const { return task_.has_value(); }
+
+  StateEnum CurrentState() const { return enum_; }
+  Context* MutableContext() { return context_; }
+
+ private:
+  void Enter(StateEnum state_enum) {
+    task_.reset();
+    enum_ = state_enum;
+    auto it = states_->find(state_enum);
+    if (it == states_->end()) {
+      return;
+    }
+    task_.emplace(it->second(*this, context_));
+    task_->handle_.resume();
+    TransitionIfDone();
+  }
+
+  void Resume() {
+    task_->handle_.resume();
+    TransitionIfDone();
+  }
+
+  // Moves to the next state once the current one has returned. A state that
+  // returns without waiting moves on immediately.
+  void TransitionIfDone() {
+    while (task_ && task_->handle_.done()) {
+      StateEnum next_enum = task_->handle_.promise().next_state;
+      task_.reset();
+      enum_ = next_enum;
+      auto it = states_->find(next_enum);
+      if (it == states_->end()) {
+        return;
+      }
+      task_.emplace(it->second(*this, context_));
+      task_->handle_.resume();
+    }
+  }
+
+  StateEnum enum_{};
+  Context* context_;
+  std::shared_ptr<States> states_;
+  std::optional<Task> task_;
+  Matcher matcher_;
+  std::optional<Clock::time_point> deadline_;
+  bool timed_out_ = false;
+};
+
+}  // namespace state_machine
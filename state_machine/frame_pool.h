@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace state_machine {
+
+// Allocator for coroutine frames. Frames are rounded up to a multiple of
+// kGranularity and served from per thread free lists, which are refilled a
+// chunk at a time. Frames larger than kMaxPooledSize use the global heap.
+// Memory is kept for reuse by the thread and never returned.
+class FramePool {
+ public:
+  static constexpr size_t kGranularity = 64;
+  static constexpr size_t kMaxPooledSize = 1024;
+  static constexpr size_t kFramesPerChunk = 32;
+
+  static void* Allocate(size_t size) {
+    if (size > kMaxPooledSize) {
+      return ::operator new(size);
+    }
+    return Local().Allocate(ClassOf(size));
+  }
+
+  static void Deallocate(void* frame, size_t size) {
+    if (size > kMaxPooledSize) {
+      ::operator delete(frame);
+      return;
+    }
+    Local().Deallocate(frame, ClassOf(size));
+  }
+
+ private:
+  static constexpr size_t kNumClasses = kMaxPooledSize / kGranularity;
+
+  struct FreeFrame {
+    FreeFrame* next;
+  };
+
+  struct Pools {
+    std::array<FreeFrame*, kNumClasses> free_lists{};
+    std::vector<std::unique_ptr<std::byte[]>> chunks;
+
+    void* Allocate(size_t size_class) {
+      if (free_lists[size_class] == nullptr) {
+        Refill(size_class);
+      }
+      FreeFrame* frame = free_lists[size_class];
+      free_lists[size_class] = frame->next;
+      return frame;
+    }
+
+    void Deallocate(void* frame, size_t size_class) {
+      auto* free_frame = static_cast<FreeFrame*>(frame);
+      free_frame->next = free_lists[size_class];
+      free_lists[size_class] = free_frame;
+    }
+
+    void Refill(size_t size_class) {
+      size_t frame_size = (size_class + 1) * kGranularity;
+      auto chunk = std::make_unique<std::byte[]>(frame_size * kFramesPerChunk);
+      for (size_t i = 0; i < kFramesPerChunk; ++i) {
+        Deallocate(chunk.get() + i * frame_size, size_class);
+      }
+      chunks.push_back(std::move(chunk));
+    }
+  };
+
+  static size_t ClassOf(size_t size) {
+    return size == 0 ? 0 : (size - 1) / kGranularity;
+  }
+
+  static Pools& Local() {
+    thread_local Pools pools;
+    return pools;
+  }
+};
+
+}  // namespace state_machine
@@ -1,3 +1,6 @@
+#pragma once
+
+#include <memory>
 #include <type_traits>
 #include <unordered_map>
 
@@ -46,6 +49,8 @@ public:
         }
     }
 
+    StateEnum CurrentState() const { return enum_; }
+
     Context* MutableContext() { return context_; }
 private:
     StateEnum enum_;
@@ -0,0 +1,999 @@
+#pragma once
+
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#include "perfect_hash.h"
+
+namespace ps_client {
+
+// Converts teams between the Showdown export text, the Showdown JSON set
+// array and the packed format sent with /utm. Every input is read in a single
+// pass: fields of a set are kept as views into the input and written out in
+// packed order once the set ends.
+namespace team_codec {
+
+inline constexpr size_t kMaxTeamSize = 6;
+inline constexpr size_t kMaxMoves = 4;
+inline constexpr int kMaxEvs = 255;
+inline constexpr int kMaxTotalEvs = 510;
+inline constexpr int kMaxIv = 31;
+
+// Stats in packed and export order.
+inline constexpr std::array<std::string_view, 6> kStatIds{"hp",  "atk", "def",
+                                                          "spa", "spd", "spe"};
+inline constexpr std::array<std::string_view, 6> kStatNames{
+    "HP", "Atk", "Def", "SpA", "SpD", "Spe"};
+
+// A pokemon set whose text fields point into the input being converted.
+struct PokemonSet {
+  std::string_view name;
+  std::string_view species;
+  std::string_view item;
+  std::string_view ability;
+  std::array<std::string_view, kMaxMoves> moves;
+  size_t move_count = 0;
+  std::string_view nature;
+  std::string_view gender;
+  std::array<int, 6> evs{0, 0, 0, 0, 0, 0};
+  std::array<int, 6> ivs{kMaxIv, kMaxIv, kMaxIv, kMaxIv, kMaxIv, kMaxIv};
+  bool shiny = false;
+  int level = 100;
+  int happiness = 255;
+  std::string_view pokeball;
+  std::string_view hp_type;
+  bool gigantamax = false;
+  int dynamax_level = 10;
+  std::string_view tera_type;
+
+  bool AddMove(std::string_view move) {
+    if (move_count == kMaxMoves) {
+      return false;
+    }
+    moves[move_count++] = move;
+    return true;
+  }
+
+  // Checks the limits the server would otherwise reject the team for.
+  bool Valid() const {
+    if (species.empty() && name.empty()) {
+      return false;
+    }
+    if (move_count == 0 || level < 1 || level > 100 || happiness < 0 ||
+        happiness > 255) {
+      return false;
+    }
+    int total_evs = 0;
+    for (size_t i = 0; i < 6; ++i) {
+      if (evs[i] < 0 || evs[i] > kMaxEvs || ivs[i] < 0 || ivs[i] > kMaxIv) {
+        return false;
+      }
+      total_evs += evs[i];
+    }
+    return total_evs <= kMaxTotalEvs;
+  }
+};
+
+// Appends the packed id of a name: its Showdown id, lowercase letters and
+// digits only, so "Life Orb" packs as "lifeorb".
+inline void AppendPackedName(std::string_view name, std::string& out) {
+  for (char c : name) {
+    char id_char = dex::ToIdChar(c);
+    if (id_char != '\0') {
+      out += id_char;
+    }
+  }
+}
+
+// Compares two names by their Showdown ids.
+inline bool SamePackedName(std::string_view a, std::string_view b) {
+  size_t i = 0;
+  size_t j = 0;
+  while (true) {
+    while (i < a.size() && dex::ToIdChar(a[i]) == '\0') {
+      ++i;
+    }
+    while (j < b.size() && dex::ToIdChar(b[j]) == '\0') {
+      ++j;
+    }
+    if (i == a.size() || j == b.size()) {
+      return i == a.size() && j == b.size();
+    }
+    if (dex::ToIdChar(a[i++]) != dex::ToIdChar(b[j++])) {
+      return false;
+    }
+  }
+}
+
+// Appends a set in packed format, preceded by ']' if it is not the first.
+inline void AppendPackedSet(const PokemonSet& set, std::string& out) {
+  if (!out.empty()) {
+    out += ']';
+  }
+  std::string_view species = set.species.empty() ? set.name : set.species;
+  out += set.name.empty() ? species : set.name;
+  out += '|';
+  if (!set.name.empty() && !SamePackedName(set.name, species)) {
+    AppendPackedName(species, out);
+  }
+  out += '|';
+  AppendPackedName(set.item, out);
+  out += '|';
+  AppendPackedName(set.ability, out);
+  out += '|';
+  for (size_t i = 0; i < set.move_count; ++i) {
+    if (i > 0) {
+      out += ',';
+    }
+    AppendPackedName(set.moves[i], out);
+  }
+  out += '|';
+  out += set.nature;
+
+  auto append_stats = [&out](const std::array<int, 6>& stats, int omitted) {
+    out += '|';
+    bool any = false;
+    for (int value : stats) {
+      any |= value != omitted;
+    }
+    if (!any) {
+      return;
+    }
+    for (size_t i = 0; i < 6; ++i) {
+      if (i > 0) {
+        out += ',';
+      }
+      if (stats[i] != omitted) {
+        out += std::to_string(stats[i]);
+      }
+    }
+  };
+  append_stats(set.evs, 0);
+  out += '|';
+  out += set.gender;
+  append_stats(set.ivs, kMaxIv);
+  out += set.shiny ? "|S|" : "||";
+  if (set.level != 100) {
+    out += std::to_string(set.level);
+  }
+  out += '|';
+  if (set.happiness != 255) {
+    out += std::to_string(set.happiness);
+  }
+  if (!set.pokeball.empty() || !set.hp_type.empty() || set.gigantamax ||
+      set.dynamax_level != 10 || !set.tera_type.empty()) {
+    out += ',';
+    out += set.hp_type;
+    out += ',';
+    AppendPackedName(set.pokeball, out);
+    out += set.gigantamax ? ",G," : ",,";
+    if (set.dynamax_level != 10) {
+      out += std::to_string(set.dynamax_level);
+    }
+    out += ',';
+    out += set.tera_type;
+  }
+}
+
+inline std::string_view Trim(std::string_view text) {
+  size_t begin = text.find_first_not_of(" \t\r");
+  if (begin == std::string_view::npos) {
+    return {};
+  }
+  return text.substr(begin, text.find_last_not_of(" \t\r") - begin + 1);
+}
+
+inline bool ParseInt(std::string_view text, int& value) {
+  text = Trim(text);
+  auto [end, ec] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  return ec == std::errc() && end == text.data() + text.size();
+}
+
+// Parses "252 HP / 4 Def / 252 Spe" into `stats`.
+inline bool ParseExportStats(std::string_view text, std::array<int, 6>& stats) {
+  while (!text.empty()) {
+    auto slash = text.find('/');
+    std::string_view entry = Trim(text.substr(0, slash));
+    text = slash == std::string_view::npos ? std::string_view{}
+                                           : text.substr(slash + 1);
+    auto space = entry.find(' ');
+    if (space == std::string_view::npos) {
+      return false;
+    }
+    std::string_view stat = Trim(entry.substr(space + 1));
+    size_t i = 0;
+    while (i < 6 && kStatNames[i] != stat) {
+      ++i;
+    }
+    if (i == 6 || !ParseInt(entry.substr(0, space), stats[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Parses "Nickname (Species) (M) @ Item".
+inline void ParseExportHeader(std::string_view line, PokemonSet& set) {
+  auto at = line.rfind(" @ ");
+  if (at != std::string_view::npos) {
+    set.item = Trim(line.substr(at + 3));
+    line = Trim(line.substr(0, at));
+  }
+  if (line.ends_with(" (M)") || line.ends_with(" (F)")) {
+    set.gender = line.substr(line.size() - 2, 1);
+    line = Trim(line.substr(0, line.size() - 4));
+  }
+  auto open = line.rfind(" (");
+  if (line.ends_with(')') && open != std::string_view::npos) {
+    set.name = Trim(line.substr(0, open));
+    set.species = line.substr(open + 2, line.size() - open - 3);
+  } else {
+    set.species = line;
+  }
+}
+
+// Converts a team in Showdown export text to packed format.
+inline std::optional<std::string> ExportToPacked(std::string_view text) {
+  std::string packed;
+  packed.reserve(text.size() / 2);
+  PokemonSet set;
+  bool in_set = false;
+  size_t team_size = 0;
+
+  auto finish_set = [&]() {
+    if (!in_set) {
+      return true;
+    }
+    in_set = false;
+    if (!set.Valid() || ++team_size > kMaxTeamSize) {
+      return false;
+    }
+    AppendPackedSet(set, packed);
+    set = PokemonSet{};
+    return true;
+  };
+
+  while (true) {
+    auto newline = text.find('\n');
+    std::string_view line = Trim(text.substr(0, newline));
+    if (line.empty() || line.starts_with("===")) {
+      if (!finish_set()) {
+        return std::nullopt;
+      }
+    } else if (!in_set) {
+      in_set = true;
+      ParseExportHeader(line, set);
+    } else if (line.starts_with("- ")) {
+      if (!set.AddMove(Trim(line.substr(2)))) {
+        return std::nullopt;
+      }
+    } else if (line.starts_with("Ability:")) {
+      set.ability = Trim(line.substr(8));
+    } else if (line.starts_with("Level:")) {
+      if (!ParseInt(line.substr(6), set.level)) {
+        return std::nullopt;
+      }
+    } else if (line.starts_with("Shiny:")) {
+      set.shiny = Trim(line.substr(6)) == "Yes";
+    } else if (line.starts_with("Happiness:")) {
+      if (!ParseInt(line.substr(10), set.happiness)) {
+        return std::nullopt;
+      }
+    } else if (line.starts_with("Pokeball:")) {
+      set.pokeball = Trim(line.substr(9));
+    } else if (line.starts_with("Hidden Power:")) {
+      set.hp_type = Trim(line.substr(13));
+    } else if (line.starts_with("Dynamax Level:")) {
+      if (!ParseInt(line.substr(14), set.dynamax_level)) {
+        return std::nullopt;
+      }
+    } else if (line.starts_with("Gigantamax:")) {
+      set.gigantamax = Trim(line.substr(11)) == "Yes";
+    } else if (line.starts_with("Tera Type:")) {
+      set.tera_type = Trim(line.substr(10));
+    } else if (line.starts_with("EVs:")) {
+      if (!ParseExportStats(line.substr(4), set.evs)) {
+        return std::nullopt;
+      }
+    } else if (line.starts_with("IVs:")) {
+      if (!ParseExportStats(line.substr(4), set.ivs)) {
+        return std::nullopt;
+      }
+    } else if (line.ends_with(" Nature")) {
+      set.nature = line.substr(0, line.size() - 7);
+    }
+
+    if (newline == std::string_view::npos) {
+      break;
+    }
+    text = text.substr(newline + 1);
+  }
+  if (!finish_set() || team_size == 0) {
+    return std::nullopt;
+  }
+  return packed;
+}
+
+// Minimal pull reader for the JSON sent over the FIFO. Strings without escapes
+// are returned as views into the input; escaped strings are decoded into
+// storage owned by the reader.
+class JsonReader {
+ public:
+  explicit JsonReader(std::string_view json) : json_(json) {}
+
+  bool AtEnd() {
+    SkipWhitespace();
+    return pos_ == json_.size();
+  }
+
+  char Peek() {
+    SkipWhitespace();
+    return pos_ < json_.size() ? json_[pos_] : '\0';
+  }
+
+  bool Consume(char c) {
+    if (Peek() != c) {
+      return false;
+    }
+    ++pos_;
+    return true;
+  }
+
+  std::optional<std::string_view> ReadString() {
+    if (!Consume('"')) {
+      return std::nullopt;
+    }
+    size_t begin = pos_;
+    while (pos_ < json_.size() && json_[pos_] != '"' && json_[pos_] != '\\') {
+      ++pos_;
+    }
+    if (pos_ == json_.size()) {
+      return std::nullopt;
+    }
+    if (json_[pos_] == '"') {
+      return json_.substr(begin, pos_++ - begin);
+    }
+
+    std::string& decoded = storage_.emplace_back(json_.substr(begin, pos_ - begin));
+    while (pos_ < json_.size() && json_[pos_] != '"') {
+      if (json_[pos_] != '\\') {
+        size_t run_end = json_.find_first_of("\"\\", pos_);
+        if (run_end == std::string_view::npos) {
+          return std::nullopt;
+        }
+        decoded += json_.substr(pos_, run_end - pos_);
+        pos_ = run_end;
+        continue;
+      }
+      if (++pos_ == json_.size()) {
+        return std::nullopt;
+      }
+      char escaped = json_[pos_++];
+      switch (escaped) {
+        case 'n':
+          decoded += '\n';
+          break;
+        case 't':
+          decoded += '\t';
+          break;
+        case 'r':
+          decoded += '\r';
+          break;
+        case 'b':
+          decoded += '\b';
+          break;
+        case 'f':
+          decoded += '\f';
+          break;
+        case 'u': {
+          unsigned code = 0;
+          if (pos_ + 4 > json_.size() ||
+              std::from_chars(json_.data() + pos_, json_.data() + pos_ + 4,
+                              code, 16)
+                      .ptr != json_.data() + pos_ + 4) {
+            return std::nullopt;
+          }
+          pos_ += 4;
+          AppendUtf8(code, decoded);
+          break;
+        }
+        default:
+          decoded += escaped;
+      }
+    }
+    if (pos_ == json_.size()) {
+      return std::nullopt;
+    }
+    ++pos_;
+    return std::string_view(decoded);
+  }
+
+  std::optional<int> ReadInt() {
+    SkipWhitespace();
+    int value = 0;
+    auto [end, ec] = std::from_chars(json_.data() + pos_,
+                                     json_.data() + json_.size(), value);
+    if (ec != std::errc()) {
+      return std::nullopt;
+    }
+    pos_ = end - json_.data();
+    return value;
+  }
+
+  std::optional<bool> ReadBool() {
+    SkipWhitespace();
+    if (json_.substr(pos_).starts_with("true")) {
+      pos_ += 4;
+      return true;
+    }
+    if (json_.substr(pos_).starts_with("false")) {
+      pos_ += 5;
+      return false;
+    }
+    return std::nullopt;
+  }
+
+  // Skips over any value, including nested objects and arrays.
+  bool SkipValue() {
+    char c = Peek();
+    if (c == '"') {
+      return ReadString().has_value();
+    }
+    if (c == '{' || c == '[') {
+      char close = c == '{' ? '}' : ']';
+      ++pos_;
+      if (Consume(close)) {
+        return true;
+      }
+      do {
+        if (c == '{' && (!ReadString() || !Consume(':'))) {
+          return false;
+        }
+        if (!SkipValue()) {
+          return false;
+        }
+      } while (Consume(','));
+      return Consume(close);
+    }
+    size_t begin = pos_;
+    while (pos_ < json_.size() && json_[pos_] != ',' && json_[pos_] != '}' &&
+           json_[pos_] != ']' && !std::isspace(static_cast<unsigned char>(json_[pos_]))) {
+      ++pos_;
+    }
+    return pos_ > begin;
+  }
+
+ private:
+  void SkipWhitespace() {
+    while (pos_ < json_.size() &&
+           std::isspace(static_cast<unsigned char>(json_[pos_]))) {
+      ++pos_;
+    }
+  }
+
+  static void AppendUtf8(unsigned code, std::string& out) {
+    if (code < 0x80) {
+      out += static_cast<char>(code);
+    } else if (code < 0x800) {
+      out += static_cast<char>(0xC0 | (code >> 6));
+      out += static_cast<char>(0x80 | (code & 0x3F));
+    } else {
+      out += static_cast<char>(0xE0 | (code >> 12));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+  }
+
+  std::string_view json_;
+  size_t pos_ = 0;
+  // Deque so views into decoded strings stay valid as more are added.
+  std::deque<std::string> storage_;
+};
+
+// Reads a {"hp": 252, ...} stats object into `stats`.
+inline bool ReadJsonStats(JsonReader& reader, std::array<int, 6>& stats) {
+  if (!reader.Consume('{')) {
+    return false;
+  }
+  if (reader.Consume('}')) {
+    return true;
+  }
+  do {
+    std::optional<std::string_view> key = reader.ReadString();
+    if (!key || !reader.Consume(':')) {
+      return false;
+    }
+    size_t i = 0;
+    while (i < 6 && kStatIds[i] != *key) {
+      ++i;
+    }
+    if (i == 6) {
+      if (!reader.SkipValue()) {
+        return false;
+      }
+      continue;
+    }
+    std::optional<int> value = reader.ReadInt();
+    if (!value) {
+      return false;
+    }
+    stats[i] = *value;
+  } while (reader.Consume(','));
+  return reader.Consume('}');
+}
+
+// Reads one JSON set object.
+inline bool ReadJsonSet(JsonReader& reader, PokemonSet& set) {
+  if (!reader.Consume('{')) {
+    return false;
+  }
+  if (reader.Consume('}')) {
+    return true;
+  }
+  do {
+    std::optional<std::string_view> key = reader.ReadString();
+    if (!key || !reader.Consume(':')) {
+      return false;
+    }
+    std::string_view* text_field = nullptr;
+    int* int_field = nullptr;
+    bool* bool_field = nullptr;
+    if (*key == "name") {
+      text_field = &set.name;
+    } else if (*key == "species") {
+      text_field = &set.species;
+    } else if (*key == "item") {
+      text_field = &set.item;
+    } else if (*key == "ability") {
+      text_field = &set.ability;
+    } else if (*key == "nature") {
+      text_field = &set.nature;
+    } else if (*key == "gender") {
+      text_field = &set.gender;
+    } else if (*key == "pokeball") {
+      text_field = &set.pokeball;
+    } else if (*key == "hpType") {
+      text_field = &set.hp_type;
+    } else if (*key == "teraType") {
+      text_field = &set.tera_type;
+    } else if (*key == "level") {
+      int_field = &set.level;
+    } else if (*key == "happiness") {
+      int_field = &set.happiness;
+    } else if (*key == "dynamaxLevel") {
+      int_field = &set.dynamax_level;
+    } else if (*key == "shiny") {
+      bool_field = &set.shiny;
+    } else if (*key == "gigantamax") {
+      bool_field = &set.gigantamax;
+    } else if (*key == "evs") {
+      if (!ReadJsonStats(reader, set.evs)) {
+        return false;
+      }
+      continue;
+    } else if (*key == "ivs") {
+      if (!ReadJsonStats(reader, set.ivs)) {
+        return false;
+      }
+      continue;
+    } else if (*key == "moves") {
+      if (!reader.Consume('[')) {
+        return false;
+      }
+      if (reader.Consume(']')) {
+        continue;
+      }
+      do {
+        std::optional<std::string_view> move = reader.ReadString();
+        if (!move || !set.AddMove(*move)) {
+          return false;
+        }
+      } while (reader.Consume(','));
+      if (!reader.Consume(']')) {
+        return false;
+      }
+      continue;
+    } else {
+      if (!reader.SkipValue()) {
+        return false;
+      }
+      continue;
+    }
+
+    if (text_field != nullptr) {
+      std::optional<std::string_view> value = reader.ReadString();
+      if (!value) {
+        return false;
+      }
+      *text_field = *value;
+    } else if (int_field != nullptr) {
+      std::optional<int> value = reader.ReadInt();
+      if (!value) {
+        return false;
+      }
+      *int_field = *value;
+    } else {
+      std::optional<bool> value = reader.ReadBool();
+      if (!value) {
+        return false;
+      }
+      *bool_field = *value;
+    }
+  } while (reader.Consume(','));
+  return reader.Consume('}');
+}
+
+// Converts a JSON array of sets to packed format.
+inline std::optional<std::string> JsonSetsToPacked(JsonReader& reader) {
+  if (!reader.Consume('[')) {
+    return std::nullopt;
+  }
+  std::string packed;
+  packed.reserve(512);
+  size_t team_size = 0;
+  if (!reader.Consume(']')) {
+    do {
+      PokemonSet set;
+      if (!ReadJsonSet(reader, set) || !set.Valid() ||
+          ++team_size > kMaxTeamSize) {
+        return std::nullopt;
+      }
+      AppendPackedSet(set, packed);
+    } while (reader.Consume(','));
+    if (!reader.Consume(']')) {
+      return std::nullopt;
+    }
+  }
+  if (team_size == 0) {
+    return std::nullopt;
+  }
+  return packed;
+}
+
+// Tells a packed team from export text: a single line of '|' separated
+// fields. ValidPackedTeam checks the rest.
+inline bool LooksPacked(std::string_view team) {
+  return team.find('\n') == std::string_view::npos &&
+         team.find('|') != std::string_view::npos;
+}
+
+// Packed numbers have no surrounding whitespace to trim.
+inline bool ParsePackedInt(std::string_view text, int& value) {
+  auto [end, ec] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  return ec == std::errc() && end == text.data() + text.size();
+}
+
+// Reads up to `values.size()` comma separated numbers; empty entries keep
+// their value.
+inline bool ParsePackedNumbers(std::string_view text,
+                               std::span<int> values) {
+  for (size_t i = 0; !text.empty(); ++i) {
+    auto comma = text.find(',');
+    std::string_view value = text.substr(0, comma);
+    text = comma == std::string_view::npos ? std::string_view{}
+                                           : text.substr(comma + 1);
+    if (i == values.size() ||
+        (!value.empty() && !ParsePackedInt(value, values[i]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Reads the fields of a packed set that the limits apply to. A set has at
+// least 12 fields.
+inline bool ReadPackedSet(std::string_view text, PokemonSet& set) {
+  std::array<std::string_view, 12> fields;
+  for (size_t i = 0; i < fields.size(); ++i) {
+    auto bar = text.find('|');
+    if (bar == std::string_view::npos && i + 1 < fields.size()) {
+      return false;
+    }
+    fields[i] = text.substr(0, bar);
+    text = bar == std::string_view::npos ? std::string_view{}
+                                         : text.substr(bar + 1);
+  }
+  set.name = fields[0];
+  set.species = fields[1];
+  std::string_view moves = fields[4];
+  while (!moves.empty()) {
+    auto comma = moves.find(',');
+    if (!set.AddMove(moves.substr(0, comma))) {
+      return false;
+    }
+    moves = comma == std::string_view::npos ? std::string_view{}
+                                            : moves.substr(comma + 1);
+  }
+  std::array<int, 1> happiness{set.happiness};
+  if (!ParsePackedNumbers(fields[6], set.evs) ||
+      !ParsePackedNumbers(fields[8], set.ivs) ||
+      (!fields[10].empty() && !ParsePackedInt(fields[10], set.level)) ||
+      !ParsePackedNumbers(fields[11].substr(0, fields[11].find(',')),
+                          happiness)) {
+    return false;
+  }
+  set.happiness = happiness[0];
+  return true;
+}
+
+// Checks a packed team against the same limits as the other formats: 1 to
+// 6 valid sets.
+inline bool ValidPackedTeam(std::string_view team) {
+  if (!LooksPacked(team)) {
+    return false;
+  }
+  size_t team_size = 0;
+  while (!team.empty()) {
+    auto end = team.find(']');
+    PokemonSet set;
+    if (!ReadPackedSet(team.substr(0, end), set) || !set.Valid() ||
+        ++team_size > kMaxTeamSize) {
+      return false;
+    }
+    team = end == std::string_view::npos ? std::string_view{}
+                                         : team.substr(end + 1);
+  }
+  return true;
+}
+
+// Converts the team sent over the FIFO, {"team": <team>}, to packed format.
+// The team can be a packed string, export text, or an array of JSON sets.
+// If `converted` is given, it is set to whether the team had to be converted
+// rather than passed through already packed.
+inline std::optional<std::string> PackTeam(std::string_view payload,
+                                           bool* converted = nullptr) {
+  JsonReader reader(payload);
+  if (!reader.Consume('{')) {
+    return std::nullopt;
+  }
+  std::optional<std::string> packed;
+  if (reader.Consume('}')) {
+    return std::nullopt;
+  }
+  do {
+    std::optional<std::string_view> key = reader.ReadString();
+    if (!key || !reader.Consume(':')) {
+      return std::nullopt;
+    }
+    if (*key != "team") {
+      if (!reader.SkipValue()) {
+        return std::nullopt;
+      }
+      continue;
+    }
+    bool was_packed = false;
+    if (reader.Peek() == '[') {
+      packed = JsonSetsToPacked(reader);
+    } else {
+      std::optional<std::string_view> team = reader.ReadString();
+      if (!team) {
+        return std::nullopt;
+      }
+      if (LooksPacked(*team)) {
+        was_packed = true;
+        packed = ValidPackedTeam(*team) ? std::optional<std::string>(*team)
+                                        : std::nullopt;
+      } else {
+        packed = ExportToPacked(*team);
+      }
+    }
+    if (converted != nullptr) {
+      *converted = !was_packed;
+    }
+    if (!packed) {
+      return std::nullopt;
+    }
+  } while (reader.Consume(','));
+  if (!reader.Consume('}') || !reader.AtEnd()) {
+    return std::nullopt;
+  }
+  return packed;
+}
+
+// Converts a packed team back to export text. Items, abilities and moves are
+// written as their packed ids, which the server's importer resolves.
+inline std::string PackedToExport(std::string_view packed) {
+  std::string out;
+  while (!packed.empty()) {
+    auto end = packed.find(']');
+    std::string_view set_text = packed.substr(0, end);
+    packed = end == std::string_view::npos ? std::string_view{}
+                                           : packed.substr(end + 1);
+
+    std::array<std::string_view, 12> fields;
+    for (size_t i = 0; i < fields.size(); ++i) {
+      auto bar = set_text.find('|');
+      fields[i] = set_text.substr(0, bar);
+      set_text = bar == std::string_view::npos ? std::string_view{}
+                                               : set_text.substr(bar + 1);
+    }
+    auto [name, species, item, ability, moves, nature, evs, gender, ivs, shiny,
+          level, misc] = fields;
+
+    if (!out.empty()) {
+      out += '\n';
+    }
+    if (species.empty()) {
+      out += name;
+    } else {
+      out += name;
+      out += " (";
+      out += species;
+      out += ')';
+    }
+    if (!gender.empty()) {
+      out += " (";
+      out += gender;
+      out += ')';
+    }
+    if (!item.empty()) {
+      out += " @ ";
+      out += item;
+    }
+    out += "\nAbility: ";
+    out += ability;
+    out += '\n';
+    if (!level.empty()) {
+      out += "Level: ";
+      out += level;
+      out += '\n';
+    }
+    if (shiny == "S") {
+      out += "Shiny: Yes\n";
+    }
+
+    std::array<std::string_view, 6> extras;
+    for (size_t i = 0; i < extras.size() && !misc.empty(); ++i) {
+      auto comma = misc.find(',');
+      extras[i] = misc.substr(0, comma);
+      misc = comma == std::string_view::npos ? std::string_view{}
+                                             : misc.substr(comma + 1);
+    }
+    auto [happiness, hp_type, pokeball, gigantamax, dynamax_level, tera_type] =
+        extras;
+    if (!happiness.empty()) {
+      out += "Happiness: ";
+      out += happiness;
+      out += '\n';
+    }
+    if (!pokeball.empty()) {
+      out += "Pokeball: ";
+      out += pokeball;
+      out += '\n';
+    }
+    if (!hp_type.empty()) {
+      out += "Hidden Power: ";
+      out += hp_type;
+      out += '\n';
+    }
+    if (!dynamax_level.empty()) {
+      out += "Dynamax Level: ";
+      out += dynamax_level;
+      out += '\n';
+    }
+    if (!gigantamax.empty()) {
+      out += "Gigantamax: Yes\n";
+    }
+    if (!tera_type.empty()) {
+      out += "Tera Type: ";
+      out += tera_type;
+      out += '\n';
+    }
+
+    auto append_stats = [&out](std::string_view label, std::string_view stats) {
+      std::string line;
+      for (size_t i = 0; i < 6; ++i) {
+        auto comma = stats.find(',');
+        std::string_view value = stats.substr(0, comma);
+        stats = comma == std::string_view::npos ? std::string_view{}
+                                                : stats.substr(comma + 1);
+        if (value.empty()) {
+          continue;
+        }
+        line += line.empty() ? "" : " / ";
+        line += value;
+        line += ' ';
+        line += kStatNames[i];
+      }
+      if (!line.empty()) {
+        out += label;
+        out += line;
+        out += '\n';
+      }
+    };
+    append_stats("EVs: ", evs);
+    if (!nature.empty()) {
+      out += nature;
+      out += " Nature\n";
+    }
+    append_stats("IVs: ", ivs);
+
+    while (!moves.empty()) {
+      auto comma = moves.find(',');
+      out += "- ";
+      out += moves.substr(0, comma);
+      out += '\n';
+      moves = comma == std::string_view::npos ? std::string_view{}
+                                              : moves.substr(comma + 1);
+    }
+  }
+  return out;
+}
+
+}  // namespace team_codec
+
+// Caches packed teams by a hash of the uploaded payload, so the same team
+// uploaded again skips parsing and validation. Only converted teams are
+// cached: a team that is already packed is checked faster than a cache entry
+// is copied out. Least recently used entries are evicted past `capacity`.
+class TeamCache {
+ public:
+  explicit TeamCache(size_t capacity = 64) : capacity_(capacity) {}
+
+  // Returns the packed team for `payload`, converting it on a cache miss.
+  std::optional<std::string> GetOrPack(std::string_view payload) {
+    uint64_t key = Hash(payload);
+    auto it = index_.find(key);
+    if (it != index_.end() && it->second->payload == payload) {
+      ++hits_;
+      entries_.splice(entries_.begin(), entries_, it->second);
+      return it->second->packed;
+    }
+
+    ++misses_;
+    bool converted = false;
+    std::optional<std::string> packed =
+        team_codec::PackTeam(payload, &converted);
+    if (!packed.has_value() || !converted) {
+      return packed;
+    }
+    if (it != index_.end()) {
+      entries_.erase(it->second);
+      index_.erase(it);
+    }
+    entries_.push_front(Entry{key, std::string(payload), *packed});
+    index_[key] = entries_.begin();
+    if (entries_.size() > capacity_) {
+      index_.erase(entries_.back().key);
+      entries_.pop_back();
+    }
+    return packed;
+  }
+
+  uint64_t hits() const { return hits_; }
+  uint64_t misses() const { return misses_; }
+
+ private:
+  struct Entry {
+    uint64_t key;
+    std::string payload;
+    std::string packed;
+  };
+
+  // Word at a time, unlike a byte-wise FNV-1a that costs as much as the
+  // packed passthrough for a full team.
+  static uint64_t Hash(std::string_view data) {
+    return std::hash<std::string_view>{}(data);
+  }
+
+  size_t capacity_;
+  std::list<Entry> entries_;
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+};
+
+}  // namespace ps_client
@@ -0,0 +1,150 @@
+// Compares team_codec and TeamCache with parsing the FIFO team payload with
+// nlohmann::json, which Team::CreateTeam used before.
+//
+// Usage: team_codec_bench [iterations]
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "team_codec.h"
+
+namespace {
+
+constexpr std::string_view kExportTeam =
+    "Garchomp @ Choice Scarf\n"
+    "Ability: Rough Skin\n"
+    "Tera Type: Ground\n"
+    "EVs: 252 Atk / 4 SpD / 252 Spe\n"
+    "Jolly Nature\n"
+    "- Earthquake\n"
+    "- Outrage\n"
+    "- Stone Edge\n"
+    "- Fire Fang\n"
+    "\n"
+    "Rotom-Wash @ Leftovers\n"
+    "Ability: Levitate\n"
+    "EVs: 252 HP / 212 Def / 44 SpD\n"
+    "Bold Nature\n"
+    "IVs: 0 Atk\n"
+    "- Hydro Pump\n"
+    "- Volt Switch\n"
+    "- Will-O-Wisp\n"
+    "- Pain Split\n"
+    "\n"
+    "Ferrothorn @ Rocky Helmet\n"
+    "Ability: Iron Barbs\n"
+    "EVs: 252 HP / 88 Def / 168 SpD\n"
+    "Relaxed Nature\n"
+    "IVs: 0 Spe\n"
+    "- Stealth Rock\n"
+    "- Leech Seed\n"
+    "- Power Whip\n"
+    "- Knock Off\n"
+    "\n"
+    "Latios (M) @ Soul Dew\n"
+    "Ability: Levitate\n"
+    "EVs: 4 HP / 252 SpA / 252 Spe\n"
+    "Timid Nature\n"
+    "- Draco Meteor\n"
+    "- Psyshock\n"
+    "- Surf\n"
+    "- Recover\n"
+    "\n"
+    "Heatran @ Air Balloon\n"
+    "Ability: Flash Fire\n"
+    "EVs: 252 SpA / 4 SpD / 252 Spe\n"
+    "Timid Nature\n"
+    "IVs: 0 Atk\n"
+    "- Magma Storm\n"
+    "- Earth Power\n"
+    "- Taunt\n"
+    "- Flash Cannon\n"
+    "\n"
+    "Scizor @ Choice Band\n"
+    "Ability: Technician\n"
+    "Level: 50\n"
+    "EVs: 248 HP / 252 Atk / 8 SpD\n"
+    "Adamant Nature\n"
+    "- Bullet Punch\n"
+    "- U-turn\n"
+    "- Superpower\n"
+    "- Pursuit\n";
+
+std::string Payload(std::string_view team) {
+  return nlohmann::json{{"team", team}}.dump();
+}
+
+template <typename Fn>
+void Run(std::string_view name, size_t iterations, Fn fn) {
+  size_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    sink += fn();
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << name << ": " << elapsed.count() / iterations << " ns/op"
+            << (sink == 0 ? " (no output)" : "") << std::endl;
+}
+
+size_t NlohmannTeam(const std::string& payload) {
+  try {
+    std::string team = nlohmann::json::parse(payload)["team"];
+    return team.size();
+  } catch (const nlohmann::json::exception&) {
+    return 0;
+  }
+}
+
+size_t CodecTeam(const std::string& payload) {
+  std::optional<std::string> packed = ps_client::team_codec::PackTeam(payload);
+  return packed ? packed->size() : 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+  if (iterations == 0) {
+    std::cerr << "Usage: " << argv[0] << " [iterations]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::string export_payload = Payload(kExportTeam);
+  std::optional<std::string> packed =
+      ps_client::team_codec::PackTeam(export_payload);
+  if (!packed) {
+    std::cerr << "Sample team does not pack" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::string packed_payload = Payload(*packed);
+  std::string chat_frame = "|c|+someone|hello there";
+
+  Run("nlohmann export payload", iterations,
+      [&] { return NlohmannTeam(export_payload); });
+  Run("codec export payload", iterations,
+      [&] { return CodecTeam(export_payload); });
+  Run("nlohmann packed payload", iterations,
+      [&] { return NlohmannTeam(packed_payload); });
+  Run("codec packed payload", iterations,
+      [&] { return CodecTeam(packed_payload); });
+
+  ps_client::TeamCache cache;
+  Run("cache export payload", iterations, [&] {
+    std::optional<std::string> team = cache.GetOrPack(export_payload);
+    return team ? team->size() : 0;
+  });
+  Run("cache packed payload", iterations, [&] {
+    std::optional<std::string> team = cache.GetOrPack(packed_payload);
+    return team ? team->size() : 0;
+  });
+
+  Run("nlohmann non-json frame", iterations,
+      [&] { return NlohmannTeam(chat_frame) + 1; });
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <boost/asio/io_context.hpp>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <string_view>
+
+#include "shared_queue.h"
+#include "util.h"
+
+namespace ps_client {
+
+// Where the client threads run: the io thread reading the socket, the
+// handler thread parsing messages and running the state machine (and a
+// decision plugin), and the FIFO reader thread. Spinning and busy-polling
+// only pay off when each spinning thread has a core to itself.
+struct ThreadLayout {
+  // CPU to pin each thread to, or -1 to leave it to the scheduler.
+  int io_cpu = -1;
+  int handler_cpu = -1;
+  int fifo_cpu = -1;
+  // Spin on io_context::poll() instead of blocking in run().
+  bool busy_poll = false;
+  // Times the handler checks the message queue before parking on it.
+  uint32_t spin_iterations = 0;
+  // Read the socket and run the state machine on the handler thread. Always
+  // busy-polls, since FIFO commands arrive through the message queue and
+  // would not wake a blocked io_context.
+  bool single_thread = false;
+
+  // Parses a comma-separated list of "io:CPU", "handler:CPU", "fifo:CPU",
+  // "busy-poll", "spin:N" and "single-thread". Returns nullopt if an item is
+  // not understood.
+  static std::optional<ThreadLayout> Parse(std::string_view spec) {
+    ThreadLayout layout;
+    for (std::string_view item : util::SplitLine(spec, ',')) {
+      std::string_view key = item.substr(0, item.find(':'));
+      std::string_view value =
+          key.size() < item.size() ? item.substr(key.size() + 1) : "";
+      bool ok = true;
+      if (key == "io") {
+        ok = util::ParseNumber(value, layout.io_cpu);
+      } else if (key == "handler") {
+        ok = util::ParseNumber(value, layout.handler_cpu);
+      } else if (key == "fifo") {
+        ok = util::ParseNumber(value, layout.fifo_cpu);
+      } else if (key == "spin") {
+        ok = util::ParseNumber(value, layout.spin_iterations);
+      } else if (item == "busy-poll") {
+        layout.busy_poll = true;
+      } else if (item == "single-thread") {
+        layout.single_thread = true;
+        layout.busy_poll = true;
+      } else {
+        ok = false;
+      }
+      if (!ok) {
+        std::cerr << "Bad thread layout item: " << item << std::endl;
+        return std::nullopt;
+      }
+    }
+    return layout;
+  }
+};
+
+// Pins the calling thread to `cpu`. Does nothing for a negative cpu.
+// Returns false on error.
+inline bool PinCurrentThread(int cpu) {
+  if (cpu < 0) {
+    return true;
+  }
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+  if (error != 0) {
+    std::cerr << "Failed to pin thread to CPU " << cpu << ": "
+              << std::strerror(error) << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Runs `ioc` on the calling thread until it is stopped or out of work.
+inline void RunIoContext(boost::asio::io_context& ioc, bool busy_poll) {
+  if (!busy_poll) {
+    ioc.run();
+    return;
+  }
+  while (!ioc.stopped()) {
+    if (ioc.poll() == 0) {
+      util::CpuRelax();
+    }
+  }
+}
+
+}  // namespace ps_client
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+// Hierarchical timing wheel. Time is counted in ticks; timers are armed a
+// number of ticks ahead and fire when Advance() reaches them. Arm and Cancel
+// are O(1); Advance is O(1) per tick plus the timers it fires or cascades.
+//
+// There are kLevels wheels of kSlots slots. Level l holds timers due within
+// kSlots^(l+1) ticks, and is cascaded into the level below each time that
+// level wraps around. Timers live in a slab and are linked into their slot
+// by index, so arming reuses memory and no per-timer allocation happens
+// beyond the payload itself.
+//
+// Not thread-safe.
+template <typename T>
+class TimerWheel {
+ public:
+  // Identifies an armed timer. Stale ids are ignored by Cancel.
+  using TimerId = uint64_t;
+
+  static constexpr size_t kSlotBits = 6;
+  static constexpr size_t kSlots = size_t{1} << kSlotBits;
+  static constexpr size_t kLevels = 4;
+  // Delays are clamped to this many ticks.
+  static constexpr uint64_t kMaxDelay =
+      (uint64_t{1} << (kSlotBits * kLevels)) - 1;
+
+  TimerWheel() { slots_.fill(kNil); }
+
+  // Arms a timer firing `delay` ticks from now, at least one tick ahead.
+  TimerId Arm(uint64_t delay, T payload) {
+    delay = delay == 0 ? 1 : (delay > kMaxDelay ? kMaxDelay : delay);
+    uint32_t index = AllocateNode();
+    Node& node = nodes_[index];
+    node.expiry = now_ + delay;
+    node.payload = std::move(payload);
+    node.armed = true;
+    Link(index);
+    ++armed_;
+    return MakeId(index, node.generation);
+  }
+
+  // Disarms a timer. Returns false if it already fired or was cancelled.
+  bool Cancel(TimerId id) {
+    uint32_t index = static_cast<uint32_t>(id);
+    if (index >= nodes_.size() || !nodes_[index].armed ||
+        nodes_[index].generation != static_cast<uint32_t>(id >> 32)) {
+      return false;
+    }
+    Unlink(index);
+    FreeNode(index);
+    return true;
+  }
+
+  // Moves time forward to `tick`, calling `on_expired(id, payload)` for
+  // every timer that comes due. Callbacks may arm and cancel timers.
+  template <typename Fn>
+  void Advance(uint64_t tick, Fn&& on_expired) {
+    while (now_ < tick) {
+      if (armed_ == 0) {
+        now_ = tick;
+        return;
+      }
+      ++now_;
+      for (size_t level = 1; level < kLevels && SlotOf(now_, level - 1) == 0;
+           ++level) {
+        Cascade(level);
+      }
+      uint32_t& head = slots_[SlotIndex(0, SlotOf(now_, 0))];
+      while (head != kNil) {
+        uint32_t index = head;
+        Unlink(index);
+        TimerId id = MakeId(index, nodes_[index].generation);
+        T payload = std::move(nodes_[index].payload);
+        FreeNode(index);
+        on_expired(id, std::move(payload));
+      }
+    }
+  }
+
+  uint64_t Now() const { return now_; }
+  size_t Armed() const { return armed_; }
+
+ private:
+  static constexpr uint32_t kNil = UINT32_MAX;
+
+  struct Node {
+    uint64_t expiry = 0;
+    uint32_t prev = kNil;
+    uint32_t next = kNil;
+    uint32_t generation = 0;
+    uint32_t slot = 0;
+    bool armed = false;
+    T payload{};
+  };
+
+  static TimerId MakeId(uint32_t index, uint32_t generation) {
+    return (static_cast<uint64_t>(generation) << 32) | index;
+  }
+
+  static size_t SlotOf(uint64_t tick, size_t level) {
+    return (tick >> (kSlotBits * level)) & (kSlots - 1);
+  }
+
+  static size_t SlotIndex(size_t level, size_t slot) {
+    return level * kSlots + slot;
+  }
+
+  uint32_t AllocateNode() {
+    if (free_head_ != kNil) {
+      uint32_t index = free_head_;
+      free_head_ = nodes_[index].next;
+      return index;
+    }
+    nodes_.emplace_back();
+    return static_cast<uint32_t>(nodes_.size() - 1);
+  }
+
+  void FreeNode(uint32_t index) {
+    Node& node = nodes_[index];
+    node.armed = false;
+    node.payload = T{};
+    ++node.generation;
+    node.next = free_head_;
+    free_head_ = index;
+    --armed_;
+  }
+
+  // Puts a node in the slot of the lowest level that covers its expiry.
+  void Link(uint32_t index) {
+    Node& node = nodes_[index];
+    uint64_t delta = node.expiry - now_;
+    size_t level = 0;
+    while (level + 1 < kLevels && delta >= (uint64_t{1} << (kSlotBits * (level + 1)))) {
+      ++level;
+    }
+    node.slot = static_cast<uint32_t>(SlotIndex(level, SlotOf(node.expiry, level)));
+    node.prev = kNil;
+    node.next = slots_[node.slot];
+    if (node.next != kNil) {
+      nodes_[node.next].prev = index;
+    }
+    slots_[node.slot] = index;
+  }
+
+  void Unlink(uint32_t index) {
+    Node& node = nodes_[index];
+    if (node.prev != kNil) {
+      nodes_[node.prev].next = node.next;
+    } else {
+      slots_[node.slot] = node.next;
+    }
+    if (node.next != kNil) {
+      nodes_[node.next].prev = node.prev;
+    }
+  }
+
+  // Re-links the timers of the current slot of `level` into lower levels.
+  void Cascade(size_t level) {
+    uint32_t& head = slots_[SlotIndex(level, SlotOf(now_, level))];
+    uint32_t index = head;
+    head = kNil;
+    while (index != kNil) {
+      uint32_t next = nodes_[index].next;
+      Link(index);
+      index = next;
+    }
+  }
+
+  uint64_t now_ = 0;
+  size_t armed_ = 0;
+  std::vector<Node> nodes_;
+  uint32_t free_head_ = kNil;
+  std::array<uint32_t, kLevels * kSlots> slots_;
+};
+
+}  // namespace util
@@ -1,8 +1,10 @@
 #pragma once
 
+#include <charconv>
 #include <iostream>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace util {
@@ -39,4 +41,13 @@ std::vector<std::string_view> SplitLine(std::string_view line,
   return result;
 }
 
+// Parses all of `text` as a number. Returns false if it is not one or does
+// not fit in `value`.
+template <typename T>
+bool ParseNumber(std::string_view text, T& value) {
+  auto [end, ec] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  return ec == std::errc() && end == text.data() + text.size();
+}
+
 }  // namespace util